@@ -0,0 +1,2392 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+#include "polish.hpp"
+#include "polish_jit.hpp"
+#include "polish_stats.hpp"
+#include "polish_trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace polish {
+
+Node::Node(const std::string& expression) noexcept(false)
+{
+    // 式expressionにおける括弧の対応数をチェックする
+    validate_bracket_balance(expression);
+
+    // チェックした式expressionをこのノードが表す式として設定する
+    this->expression = expression;
+
+    Statistics::count(Counter::nodes_created);
+    Statistics::count(Counter::bytes_copied, expression.length());
+}
+
+std::string ParseError::message() const
+{
+    switch (code) {
+        case ParseErrorCode::empty_expression:
+            return "empty expression";
+        case ParseErrorCode::unbalanced_bracket:
+            return std::format("unbalanced bracket: {}", subexpression());
+        case ParseErrorCode::empty_bracket:
+            return std::format("empty bracket: {}", subexpression());
+        default:
+            return "invalid expression: " + std::string(subexpression());
+    }
+}
+
+void Node::validate_bracket_balance(const std::string_view& expression) noexcept(false)
+{
+    if (!is_bracket_balanced(expression))
+        throw MalformedExpressionException(std::format("unbalanced bracket: {}", expression));
+}
+
+bool Node::is_bracket_balanced(const std::string_view& expression) noexcept
+{
+    PhaseTimer timer(Phase::validate_bracket);
+
+    auto nest_depth = 0; // 丸括弧の深度(くくられる括弧の数を計上するために用いる)
+
+    // 1文字ずつ検証する
+    for (auto& ch : expression) {
+        if ('(' == ch) {
+            // 開き丸括弧なので深度を1増やす
+            nest_depth++;
+        }
+        else if (')' == ch) {
+            // 閉じ丸括弧なので深度を1減らす
+            nest_depth--;
+
+            // 深度が負になった場合
+            if (nest_depth < 0)
+                // 式中で開かれた括弧よりも閉じ括弧が多いため、その時点で不正な式と判断する
+                // 例:"(1+2))"などの場合
+                break;
+        }
+    }
+
+    // 深度が0でない場合は、式中に開かれていない/閉じられていない括弧があるので、不正な式と判断する
+    // 例:"((1+2)"などの場合
+    return 0 == nest_depth;
+}
+
+void Node::parse_expression() noexcept(false)
+{
+    PhaseTimer timer(Phase::parse);
+
+    // 分割するとこのノードの式は演算子または項に置き換えられるため、元の式を分割元として取り出しておく
+    auto source = std::move(expression);
+    ParseFailure failure;
+
+    if (!parse_subexpression(source, failure))
+        throw MalformedExpressionException(make_parse_error(std::move(source), failure).message());
+}
+
+std::expected<std::unique_ptr<Node>, ParseError> Node::try_parse(std::string expression)
+{
+    PhaseTimer timer(Phase::parse);
+
+    if (0 == expression.length())
+        return std::unexpected(ParseError { ParseErrorCode::empty_expression, 0, 0, std::move(expression) });
+
+    if (!is_bracket_balanced(expression)) {
+        auto length = expression.length();
+
+        return std::unexpected(ParseError { ParseErrorCode::unbalanced_bracket, 0, length, std::move(expression) });
+    }
+
+    auto root = std::unique_ptr<Node>(new Node());
+    ParseFailure failure;
+
+    Statistics::count(Counter::nodes_created);
+
+    if (!root->parse_subexpression(expression, failure))
+        return std::unexpected(make_parse_error(std::move(expression), failure));
+
+    return root;
+}
+
+ParseError Node::make_parse_error(std::string&& source, const ParseFailure& failure)
+{
+    // 部分式は分割元の式を参照しているため、その先頭からの位置を求める
+    auto offset = static_cast<std::size_t>(failure.subexpression.data() - source.data());
+    auto length = failure.subexpression.length();
+
+    return ParseError { failure.code, offset, length, std::move(source) };
+}
+
+namespace {
+
+// 部分式を並列に分割するタスクの同時実行数を制限するための権利
+// 権利の数はハードウェアのスレッド数(不明な場合は1)とし、取得できなかった場合は逐次的に分割する
+// (式の長さによらず、並列に分割するために作成されるスレッドの数は権利の数までとなる)
+class ParallelParseToken {
+public:
+    ParallelParseToken() noexcept = default;
+    ParallelParseToken(const ParallelParseToken&) = delete;
+    ParallelParseToken& operator=(const ParallelParseToken&) = delete;
+
+    ~ParallelParseToken()
+    {
+        if (acquired)
+            available().fetch_add(1, std::memory_order_release);
+    }
+
+    // 権利の取得を試み、取得できた場合はtrueを返すメソッド(取得した権利は破棄時に返却する)
+    bool acquire() noexcept
+    {
+        auto& tokens = available();
+        auto count = tokens.load(std::memory_order_relaxed);
+
+        while (0 < count) {
+            if (tokens.compare_exchange_weak(count, count - 1, std::memory_order_acquire, std::memory_order_relaxed))
+                return acquired = true;
+        }
+
+        return false;
+    }
+
+private:
+    bool acquired = false;
+
+    static std::atomic<int>& available() noexcept
+    {
+        static std::atomic<int> tokens(static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+
+        return tokens;
+    }
+};
+
+} // namespace
+
+bool Node::split_subexpression(std::string_view& expression, std::string::size_type& pos_operator, ParseFailure& failure) noexcept
+{
+    // 式expressionから最も外側にある丸括弧を取り除く
+    if (!remove_outermost_bracket(expression)) {
+        failure = ParseFailure { ParseErrorCode::empty_bracket, expression };
+        return false;
+    }
+
+    // 式expressionから演算子を探して位置を取得する
+    pos_operator = get_operator_position(expression);
+
+    if (std::string::npos != pos_operator && (0 == pos_operator || (expression.length() - 1) == pos_operator)) {
+        // 演算子の位置が式の先頭または末尾の場合は不正な式と判断する
+        failure = ParseFailure { ParseErrorCode::invalid_expression, expression };
+        return false;
+    }
+
+    return true;
+}
+
+bool Node::parse_subexpression(std::string_view expression, ParseFailure& failure)
+{
+    std::string::size_type pos_operator;
+
+    // 式expressionを、最も外側にある丸括弧を取り除いて分割する演算子の位置を取得する
+    if (!split_subexpression(expression, pos_operator, failure))
+        return false;
+
+    if (std::string::npos == pos_operator) {
+        // 式expに演算子が含まれない場合、expは項であるとみなす
+        // (左右に子ノードを持たないノードとする)
+        this->expression = std::string(expression);
+        left = nullptr;
+        right = nullptr;
+
+        Statistics::count(Counter::bytes_copied, expression.length());
+
+        return true;
+    }
+
+    // 以下、演算子の位置をもとに左右の部分式に分割する
+    // (括弧の対応が取れた式を、括弧の外側にある演算子で分割するため、左右の部分式も括弧の対応が取れたものとなる)
+    auto left_expression = expression.substr(0, pos_operator);
+    auto right_expression = expression.substr(pos_operator + 1);
+
+    // 右側の部分式を分割するタスクの権利(このメソッドから戻る時点で、タスクは完了している)
+    ParallelParseToken token;
+
+    if (parallel_parse_threshold <= std::min(left_expression.length(), right_expression.length()) && token.acquire()) {
+        // 左右の部分式がどちらも十分に長く、タスクの権利を取得できた場合は、右側の部分式の分割を別のタスクで並列に行う
+        // (右側の部分木はタスク内で構築し、完了後にこのノードの子ノードとして接続する)
+        ParseFailure right_failure;
+
+        auto right_task = std::async(std::launch::async, [right_expression, &right_failure]() {
+            auto node = std::unique_ptr<Node>(new Node());
+
+            Statistics::count(Counter::nodes_created);
+
+            return node->parse_subexpression(right_expression, right_failure) ? std::move(node) : nullptr;
+        });
+
+        bool left_parsed;
+
+        try {
+            // 左側の部分式は、このスレッドで再帰的に二分木へと分割する
+            left = std::unique_ptr<Node>(new Node());
+
+            Statistics::count(Counter::nodes_created);
+
+            left_parsed = left->parse_subexpression(left_expression, failure);
+        }
+        catch (...) {
+            // 左側で例外が発生した場合も、右側のタスクの完了を待機してから送出する
+            right_task.wait();
+            throw;
+        }
+
+        // 右側のタスクの完了を待機し、分割した部分木を右の子ノードとする
+        right = right_task.get();
+
+        // 左側の部分式が不正な場合は、右側の部分式も不正な場合でも左側のエラーを報告する
+        // (逐次的に分割した場合と同じエラーを報告するため)
+        if (!left_parsed)
+            return false;
+
+        if (!right) {
+            failure = right_failure;
+            return false;
+        }
+    }
+    else {
+        // 演算子の左側を左の部分式としてノードを作成し、再帰的に二分木へと分割する
+        left = std::unique_ptr<Node>(new Node());
+
+        Statistics::count(Counter::nodes_created);
+
+        if (!left->parse_subexpression(left_expression, failure))
+            return false;
+
+        // 演算子の右側を右の部分式としてノードを作成し、再帰的に二分木へと分割する
+        right = std::unique_ptr<Node>(new Node());
+
+        Statistics::count(Counter::nodes_created);
+
+        if (!right->parse_subexpression(right_expression, failure))
+            return false;
+    }
+
+    // 残った演算子部分をこのノードに設定する
+    this->expression = std::string(expression.substr(pos_operator, 1));
+
+    Statistics::count(Counter::bytes_copied);
+
+    return true;
+}
+
+bool Node::remove_outermost_bracket(std::string_view& expression) noexcept
+{
+    auto has_outermost_bracket = false; // 最も外側に括弧を持つかどうか
+    auto nest_depth = 0; // 丸括弧の深度(式中で開かれた括弧が閉じられたかどうか調べるために用いる)
+
+    if ('(' == expression.front()) {
+        // 0文字目が開き丸括弧の場合、最も外側に丸括弧があると仮定する
+        has_outermost_bracket = true;
+        nest_depth = 1;
+    }
+
+    // 1文字目以降を1文字ずつ検証
+    for (auto it = expression.begin() + 1; it != expression.end(); it++) {
+        if ('(' == *it) {
+            // 開き丸括弧なので深度を1増やす
+            nest_depth++;
+        }
+        else if (')' == *it) {
+            // 閉じ丸括弧なので深度を1減らす
+            nest_depth--;
+
+            // 最後の文字以外で開き丸括弧がすべて閉じられた場合、最も外側には丸括弧がないと判断する
+            // 例:"(1+2)+(3+4)"などの場合
+            if (0 == nest_depth && (it + 1) != expression.end()) {
+                has_outermost_bracket = false;
+                break;
+            }
+        }
+    }
+
+    // 最も外側に丸括弧がない場合は、与えられた文字列をそのままとする
+    if (!has_outermost_bracket)
+        return true;
+
+    // 文字列の長さが2以下の場合は、つまり空の丸括弧"()"なので不正な式と判断する
+    if (expression.length() <= 2)
+        return false;
+
+    // 最初と最後の文字を取り除く(最も外側の丸括弧を取り除く)
+    expression = expression.substr(1, expression.length() - 2);
+
+    // 取り除いた後の文字列の最も外側に括弧が残っている場合
+    // 例:"((1+2))"などの場合
+    if ('(' == expression.front() && ')' == expression.back())
+        // 再帰的に呼び出して取り除く
+        return remove_outermost_bracket(expression);
+
+    // そうでない場合は処理を終える
+    return true;
+}
+
+std::string::size_type Node::get_operator_position(const std::string_view& expression) noexcept
+{
+    // 現在見つかっている演算子の位置(初期値としてstring::npos=演算子なしを設定)
+    auto pos_operator = std::string::npos;
+    // 分割位置とする演算子の分割順位のしきい値(初期値として、どの演算子の分割順位よりも大きい値を設定)
+    auto split_threshold = Operators::no_operator;
+    // 丸括弧の深度(括弧でくくられていない部分の演算子を「最も優先順位が低い」と判断するために用いる)
+    auto nest_depth = 0;
+
+    // 与えられた文字列を先頭から1文字ずつ検証する
+    for (auto it = expression.begin(); it < expression.end(); it++) {
+        // 文字の分類を分類表から求める
+        // (演算子の場合は、その優先順位と結合性から求めた分割順位となる)
+        auto rank = Operators::classify(*it);
+
+        // 演算子・丸括弧以外の文字の場合は何もしない
+        if (Operators::other == rank)
+            continue;
+
+        // 文字が丸括弧の場合は、括弧の深度を設定する
+        if (Operators::open_bracket == rank) {
+            nest_depth++;
+            continue;
+        }
+
+        if (Operators::close_bracket == rank) {
+            nest_depth--;
+            continue;
+        }
+
+        // 括弧の深度が0(丸括弧でくくられていない部分)かつ、
+        // 現在見つかっている演算子よりも優先順位が低いか、優先順位が同じで左結合の場合
+        // (左結合の場合はより右側の演算子、右結合の場合はより左側の演算子が、優先順位が低いものとなる)
+        if (0 == nest_depth && Operators::splits_at(rank, split_threshold)) {
+            // 最も優先順位が低い演算子とみなし、その位置を保存する
+            split_threshold = Operators::update_split_threshold(rank);
+            pos_operator = std::distance(expression.begin(), it);
+        }
+    }
+
+    // 見つかった演算子の位置を返す
+    return pos_operator;
+}
+
+void Node::traverse(
+    std::function<void(Node&)> on_visit,
+    std::function<void(Node&)> on_transit,
+    std::function<void(Node&)> on_leave
+)
+{
+    // このノードの行きがけに行う動作をコールバックする
+    if (on_visit)
+        on_visit(*this);
+
+    // 左に子ノードをもつ場合は、再帰的に巡回する
+    if (left)
+        left->traverse(on_visit, on_transit, on_leave);
+
+    // このノードの通りがけに行う動作をコールバックする
+    if (on_transit)
+        on_transit(*this);
+
+    // 右に子ノードをもつ場合は、再帰的に巡回する
+    if (right)
+        right->traverse(on_visit, on_transit, on_leave);
+
+    // このノードの帰りがけに行う動作をコールバックする
+    if (on_leave)
+        on_leave(*this);
+}
+
+void Node::write_postorder(std::ostream& stream)
+{
+    PhaseTimer timer(Phase::write_postorder);
+
+    // 巡回を開始する
+    traverse(
+        nullptr, // ノードへの行きがけには何もしない
+        nullptr, // ノードの通りがけには何もしない
+        // ノードからの帰りがけに、ノードの演算子または項を出力する
+        // (読みやすさのために項の後に空白を補って出力する)
+        [&stream](Node& node) { stream << node.expression << ' '; }
+    );
+}
+
+void Node::write_inorder(std::ostream& stream)
+{
+    PhaseTimer timer(Phase::write_inorder);
+
+    // 巡回を開始する
+    traverse(
+        // ノードへの行きがけに、必要なら開き括弧を補う
+        [&stream](Node& node) {
+            // 左右に項を持つ場合、読みやすさのために項の前(行きがけ)に開き括弧を補う
+            if (node.left && node.right)
+                stream << '(';
+        },
+        // ノードの通りがけに、ノードの演算子または項を出力する
+        [&stream](Node& node) {
+            // 左に子ノードを持つ場合は、読みやすさのために空白を補う
+            if (node.left)
+                stream << ' ';
+
+            // 左の子ノードから右の子ノードへ巡回する際に、ノードの演算子または項を出力する
+            stream << node.expression;
+
+            // 右に子ノードを持つ場合は、読みやすさのために空白を補う
+            if (node.right)
+                stream << ' ';
+        },
+        // ノードからの帰りがけに、必要なら閉じ括弧を補う
+        [&stream](Node& node) {
+            // 左右に項を持つ場合、読みやすさのために項の後(帰りがけ)に閉じ括弧を補う
+            if (node.left && node.right)
+                stream << ')';
+        }
+    );
+}
+
+void Node::write_preorder(std::ostream& stream)
+{
+    PhaseTimer timer(Phase::write_preorder);
+
+    // 巡回を開始する
+    traverse(
+        // ノードへの行きがけに、ノードの演算子または項を出力する
+        // (読みやすさのために項の後に空白を補って出力する)
+        [&stream](Node& node) { stream << node.expression << ' '; },
+        nullptr, // ノードの通りがけ時には何もしない
+        nullptr // ノードからの帰りがけ時には何もしない
+    );
+}
+
+Generator<const Node> Node::preorder() const
+{
+    std::vector<const Node*> stack { this };
+
+    while (!stack.empty()) {
+        auto node = stack.back();
+
+        stack.pop_back();
+
+        // ノードへの行きがけに、ノードを生成する
+        co_yield *node;
+
+        // 左の子ノードを先に巡回するため、右の子ノードを先にスタックに積む
+        if (node->right)
+            stack.push_back(node->right.get());
+
+        if (node->left)
+            stack.push_back(node->left.get());
+    }
+}
+
+Generator<const Node> Node::inorder() const
+{
+    std::vector<const Node*> stack;
+    auto node = this;
+
+    while (node || !stack.empty()) {
+        // 左の子ノードをたどれるところまでたどり、たどったノードをスタックに積む
+        for (; node; node = node->left.get()) {
+            stack.push_back(node);
+        }
+
+        node = stack.back();
+
+        stack.pop_back();
+
+        // 左の子ノードから右の子ノードへ巡回する際に、ノードを生成する
+        co_yield *node;
+
+        node = node->right.get();
+    }
+}
+
+Generator<const Node> Node::postorder() const
+{
+    std::vector<const Node*> stack;
+    const Node* node = this;
+    const Node* last = nullptr; // 直前に生成したノード
+
+    while (node || !stack.empty()) {
+        if (node) {
+            // 左の子ノードをたどり、たどったノードをスタックに積む
+            stack.push_back(node);
+            node = node->left.get();
+            continue;
+        }
+
+        auto top = stack.back();
+
+        if (top->right && last != top->right.get()) {
+            // 右の子ノードをまだ巡回していない場合は、右の子ノードをたどる
+            node = top->right.get();
+        }
+        else {
+            // ノードからの帰りがけに、ノードを生成する
+            stack.pop_back();
+
+            co_yield *top;
+
+            last = top;
+        }
+    }
+}
+
+bool Node::calculate_expression_tree(double& result_value)
+{
+    return calculate_expression_tree<double>(result_value);
+}
+
+template <typename T>
+bool Node::calculate_expression_tree(T& result_value)
+{
+    PhaseTimer timer(Phase::calculate);
+
+    // 巡回を開始する
+    // ノードからの帰りがけに、ノードが表す部分式から、その値を計算する
+    // 帰りがけに計算することによって、末端の部分木から順次計算し、再帰的に木全体の値を計算する
+    traverse(
+        nullptr, // ノードへの行きがけには何もしない
+        nullptr, // ノードの通りがけには何もしない
+        Node::calculate_node<T> // ノードからの帰りがけに、ノードの値を計算する
+    );
+
+    // ノードの値を数値に変換し、計算結果として代入する
+    return NumericTraits<T>::parse(expression, result_value);
+}
+
+template <typename T>
+void Node::calculate_node(Node& node)
+{
+    using Traits = NumericTraits<T>;
+
+    // 左右に子ノードを持たない場合、現在のノードは部分式ではなく項であり、
+    // それ以上計算できないので処理を終える
+    if (!node.left || !node.right)
+        return;
+
+    if constexpr (0 < Traits::max_exact_integer) {
+        // 計算した左右の子ノードの値がどちらも整数の場合は、数値型Tに変換せずに整数のまま演算する
+        // (数値型Tで演算した場合と結果が異なりうる場合は、以下の数値型Tでの演算を行う)
+        std::int64_t left_integer, right_integer, result_integer;
+
+        if (
+            parse_integer(node.left->expression, Traits::max_exact_integer, left_integer) &&
+            parse_integer(node.right->expression, Traits::max_exact_integer, right_integer) &&
+            calculate_integer(node.expression.front(), left_integer, right_integer, Traits::max_exact_integer, result_integer)
+        ) {
+            Statistics::count(Counter::integer_operations);
+
+            node.expression = format_integer(result_integer);
+            node.left = nullptr;
+            node.right = nullptr;
+            return;
+        }
+    }
+
+    // 計算した左右の子ノードの値を数値型Tに変換する
+    // 変換できない場合(左右の子ノードが記号を含む式などの場合)は、
+    // ノードの値が計算できないものとして、処理を終える
+    T left_operand, right_operand, result;
+
+    // 左ノードの値を数値に変換して演算子の左項left_operandの値とする
+    if (!Traits::parse(node.left->expression, left_operand))
+        // 数値型Tで扱える範囲外の値か、途中に変換できない文字があるため、計算できないものとして扱い、処理を終える
+        return;
+
+    // 右ノードの値を数値に変換して演算子の右項right_operandの値とする
+    if (!Traits::parse(node.right->expression, right_operand))
+        // 数値型Tで扱える範囲外の値か、途中に変換できない文字があるため、計算できないものとして扱い、処理を終える
+        return;
+
+    // 現在のノードの演算子に応じて左右の子ノードの値を演算する
+    if (!Traits::calculate(node.expression.front(), left_operand, right_operand, result))
+        // 演算できない演算子の場合などは計算できないものとして扱い、処理を終える
+        return;
+
+    // 演算した結果を文字列に変換して再度expressionに代入することで現在のノードの値とする
+    node.expression = Traits::format(result);
+
+    // 左右の子ノードの値からノードの値の計算結果が求まったため、
+    // このノードは左右に子ノードを持たない計算済みのノードとする
+    node.left = nullptr;
+    node.right = nullptr;
+}
+
+bool Node::parse_number(const std::string_view& expression, double& number) noexcept
+{
+    Statistics::count(Counter::parse_number_calls);
+
+    // 与えられた文字列を数値に変換する
+    [[maybe_unused]] auto [ptr, ec] = std::from_chars(
+        std::to_address(std::begin(expression)),
+        std::to_address(std::end(expression)),
+        number
+    );
+
+    // 最後の文字まで変換できた場合は、正常に変換できたと判断する
+    // そうでなければ、正常に変換できなかったと判断する
+    return ptr == std::to_address(std::end(expression));
+}
+
+bool Node::parse_integer(const std::string_view& expression, std::int64_t limit, std::int64_t& number) noexcept
+{
+    auto negative = expression.starts_with('-');
+    auto digits = expression.substr(negative ? 1 : 0);
+
+    // 数字以外の文字を含む場合(小数や指数表記の場合を含む)は整数として扱わない
+    // (limitは最大でも16桁のため、それより長い場合も範囲外として扱う)
+    if (digits.empty() || 16 < digits.length())
+        return false;
+
+    std::int64_t value = 0;
+
+    for (auto ch : digits) {
+        if (ch < '0' || '9' < ch)
+            return false;
+
+        value = value * 10 + (ch - '0');
+    }
+
+    // 範囲外の値の場合、および負のゼロの場合は整数として扱わない
+    if (limit < value || (negative && 0 == value))
+        return false;
+
+    number = negative ? -value : value;
+
+    return true;
+}
+
+bool Node::calculate_integer(char operator_char, std::int64_t left_operand, std::int64_t right_operand, std::int64_t limit, std::int64_t& result) noexcept
+{
+    // 演算子の特性(OperatorTraits)で整数での演算が定義されていない演算子の場合は整数では演算しない
+    if (!Operators::evaluate_integer(operator_char, left_operand, right_operand, limit, result))
+        return false;
+
+    return -limit <= result && result <= limit;
+}
+
+std::string Node::format_integer(std::int64_t number)
+{
+    char buffer[24];
+
+    auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), number);
+
+    return std::string(buffer, ptr);
+}
+
+std::string Node::format_number(const double& number) noexcept
+{
+    Statistics::count(Counter::format_number_calls);
+
+    // max_exact_integerの範囲内の整数(負のゼロを除く)は、%.17gでは指数表記とならず、整数として文字列化される
+    // そのため、この範囲の値は整数として文字列化する
+    if (
+        -static_cast<double>(max_exact_integer) <= number &&
+        number <= static_cast<double>(max_exact_integer) &&
+        std::trunc(number) == number &&
+        !(0.0 == number && std::signbit(number))
+    )
+        return format_integer(static_cast<std::int64_t>(number));
+
+    std::ostringstream stream;
+
+    // %.17g
+    stream.precision(17); // %.17
+    stream
+        << std::defaultfloat // %g
+        << number;
+
+    return stream.str();
+}
+
+template <std::floating_point T>
+bool NumericTraits<T>::parse(std::string_view expression, T& number) noexcept
+{
+    // doubleの場合は、Node::parse_numberと同じ変換を行う
+    if constexpr (std::is_same_v<T, double>) {
+        return Node::parse_number(expression, number);
+    }
+    else {
+        Statistics::count(Counter::parse_number_calls);
+
+        auto [ptr, ec] = std::from_chars(expression.data(), expression.data() + expression.length(), number);
+
+        return ptr == expression.data() + expression.length();
+    }
+}
+
+template <std::floating_point T>
+std::string NumericTraits<T>::format(const T& number)
+{
+    // doubleの場合は、Node::format_numberと同じ文字列化を行う
+    if constexpr (std::is_same_v<T, double>) {
+        return Node::format_number(number);
+    }
+    else {
+        Statistics::count(Counter::format_number_calls);
+
+        std::ostringstream stream;
+
+        stream.precision(std::numeric_limits<T>::max_digits10);
+        stream << std::defaultfloat << number;
+
+        return stream.str();
+    }
+}
+
+template <std::floating_point T>
+bool NumericTraits<T>::calculate(char operator_char, const T& left_operand, const T& right_operand, T& result) noexcept
+{
+    // 演算子の特性(OperatorTraits)で演算が定義されていない演算子の場合は演算できない
+    return Operators::evaluate(operator_char, left_operand, right_operand, result);
+}
+
+template struct NumericTraits<float>;
+template struct NumericTraits<double>;
+template struct NumericTraits<long double>;
+
+namespace {
+
+// 符号を除いた絶対値を返す(std::int64_tの最小値に対しても正しい値を返す)
+std::uint64_t magnitude_of(std::int64_t value) noexcept
+{
+    return value < 0 ? std::uint64_t(0) - static_cast<std::uint64_t>(value) : static_cast<std::uint64_t>(value);
+}
+
+// 絶対値magnitudeと符号negativeから値を構成する(範囲外の場合はfalseを返す)
+bool make_units(std::uint64_t magnitude, bool negative, std::int64_t& units) noexcept
+{
+    if (static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max()) < magnitude)
+        return false;
+
+    units = negative ? -static_cast<std::int64_t>(magnitude) : static_cast<std::int64_t>(magnitude);
+
+    return true;
+}
+
+} // namespace
+
+bool NumericTraits<Decimal>::parse(std::string_view expression, Decimal& number) noexcept
+{
+    Statistics::count(Counter::parse_number_calls);
+
+    auto is_digit = [](char ch) { return '0' <= ch && ch <= '9'; };
+
+    // 符号・仮数部(整数部と小数部)・指数部に分ける
+    auto negative = expression.starts_with('-');
+    auto mantissa = expression.substr(negative ? 1 : 0);
+    auto exponent_part = std::string_view();
+    auto exponent_negative = false;
+
+    if (auto pos = mantissa.find_first_of("eE"); std::string_view::npos != pos) {
+        exponent_part = mantissa.substr(pos + 1);
+        mantissa = mantissa.substr(0, pos);
+
+        if (exponent_part.starts_with('-') || exponent_part.starts_with('+')) {
+            exponent_negative = exponent_part.starts_with('-');
+            exponent_part.remove_prefix(1);
+        }
+
+        // 指数部に数字以外を含む場合、または桁数が多すぎる場合は数値として扱わない
+        if (exponent_part.empty() || 3 < exponent_part.length() || !std::all_of(exponent_part.begin(), exponent_part.end(), is_digit))
+            return false;
+    }
+
+    auto point = mantissa.find('.');
+    auto integer_part = mantissa.substr(0, point);
+    auto fraction_part = std::string_view::npos == point ? std::string_view() : mantissa.substr(point + 1);
+
+    // 数字を含まない場合や、数字以外の文字を含む場合は数値として扱わない
+    if (integer_part.empty() && fraction_part.empty())
+        return false;
+
+    if (!std::all_of(integer_part.begin(), integer_part.end(), is_digit) || !std::all_of(fraction_part.begin(), fraction_part.end(), is_digit))
+        return false;
+
+    auto exponent = 0;
+
+    for (auto ch : exponent_part) {
+        exponent = exponent * 10 + (ch - '0');
+    }
+
+    if (exponent_negative)
+        exponent = -exponent;
+
+    // 仮数部の数字の並びのうち、先頭から(小数点の位置 + 指数 + scale)桁を最小単位の数とし、その次の桁で四捨五入する
+    auto digit_at = [&](long index) {
+        auto integer_length = static_cast<long>(integer_part.length());
+
+        if (index < 0 || integer_length + static_cast<long>(fraction_part.length()) <= index)
+            return 0;
+
+        return (index < integer_length ? integer_part[index] : fraction_part[index - integer_length]) - '0';
+    };
+
+    auto end = static_cast<long>(integer_part.length()) + exponent + Decimal::scale;
+    constexpr auto max_magnitude = static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max());
+    std::uint64_t magnitude = 0;
+
+    for (long i = 0; i < end; i++) {
+        auto digit = static_cast<std::uint64_t>(digit_at(i));
+
+        if ((max_magnitude - digit) / 10 < magnitude)
+            return false;
+
+        magnitude = magnitude * 10 + digit;
+    }
+
+    if (0 <= end && 5 <= digit_at(end))
+        magnitude++;
+
+    std::int64_t units;
+
+    if (!make_units(magnitude, negative, units))
+        return false;
+
+    number = Decimal::from_units(units);
+
+    return true;
+}
+
+std::string NumericTraits<Decimal>::format(const Decimal& number)
+{
+    Statistics::count(Counter::format_number_calls);
+
+    auto magnitude = magnitude_of(number.units());
+    auto text = (number.units() < 0 ? "-" : "") + std::to_string(magnitude / Decimal::unit);
+    auto fraction = magnitude % Decimal::unit;
+
+    if (0 == fraction)
+        return text;
+
+    // 小数部は末尾の0を除いて出力する
+    auto fraction_text = std::to_string(Decimal::unit + fraction).substr(1);
+
+    fraction_text.erase(fraction_text.find_last_not_of('0') + 1);
+
+    return text + '.' + fraction_text;
+}
+
+bool NumericTraits<Decimal>::calculate(char operator_char, const Decimal& left_operand, const Decimal& right_operand, Decimal& result) noexcept
+{
+    auto left = left_operand.units();
+    auto right = right_operand.units();
+    auto left_magnitude = magnitude_of(left);
+    auto right_magnitude = magnitude_of(right);
+    auto negative = (left < 0) != (right < 0);
+    std::int64_t units;
+
+    switch (operator_char) {
+        case '+':
+        case '-': {
+            if ('-' == operator_char) {
+                if (std::numeric_limits<std::int64_t>::min() == right)
+                    return false;
+
+                right = -right;
+            }
+
+            // オーバーフローする場合は演算できない
+            if ((0 < right && std::numeric_limits<std::int64_t>::max() - right < left) || (right < 0 && left < std::numeric_limits<std::int64_t>::min() - right))
+                return false;
+
+            units = left + right;
+            break;
+        }
+
+        case '*': {
+            // left * right / unit を、left = quotient * unit + remainder に分けて求める
+            auto quotient = left_magnitude / Decimal::unit;
+            auto remainder = left_magnitude % Decimal::unit;
+
+            // 途中の積がオーバーフローする場合は演算できない
+            if (0 != right_magnitude && std::numeric_limits<std::uint64_t>::max() / right_magnitude < std::max(quotient, remainder))
+                return false;
+
+            auto fraction_product = remainder * right_magnitude;
+            auto magnitude = quotient * right_magnitude;
+            auto fraction = fraction_product / Decimal::unit + (Decimal::unit / 2 <= fraction_product % Decimal::unit ? 1 : 0);
+
+            if (std::numeric_limits<std::uint64_t>::max() - fraction < magnitude)
+                return false;
+
+            if (!make_units(magnitude + fraction, negative, units))
+                return false;
+
+            break;
+        }
+
+        case '/': {
+            // ゼロ除算は演算できない
+            if (0 == right_magnitude)
+                return false;
+
+            // left * unit / right を、整数部と小数部の各桁に分けて筆算で求める
+            auto magnitude = left_magnitude / right_magnitude;
+            auto remainder = left_magnitude % right_magnitude;
+
+            if (std::numeric_limits<std::uint64_t>::max() / Decimal::unit < magnitude)
+                return false;
+
+            magnitude *= Decimal::unit;
+
+            for (std::uint64_t place = Decimal::unit / 10; 0 < place; place /= 10) {
+                if (std::numeric_limits<std::uint64_t>::max() / 10 < remainder)
+                    return false;
+
+                remainder *= 10;
+                magnitude += remainder / right_magnitude * place;
+                remainder %= right_magnitude;
+            }
+
+            // 余りが除数の半分以上の場合は切り上げる
+            if (right_magnitude - remainder <= remainder)
+                magnitude++;
+
+            if (!make_units(magnitude, negative, units))
+                return false;
+
+            break;
+        }
+
+        case '%': {
+            // ゼロでの剰余は演算できない
+            if (0 == right_magnitude)
+                return false;
+
+            // 最小単位の数同士の剰余は丸めを必要としない(結果の符号は左項と同じとする)
+            if (!make_units(left_magnitude % right_magnitude, left < 0, units))
+                return false;
+
+            break;
+        }
+
+        // 上記以外の演算子(累乗など)の場合は演算できない
+        default:
+            return false;
+    }
+
+    result = Decimal::from_units(units);
+
+    return true;
+}
+
+template bool Node::calculate_expression_tree<float>(float& result_value);
+template bool Node::calculate_expression_tree<double>(double& result_value);
+template bool Node::calculate_expression_tree<long double>(long double& result_value);
+template bool Node::calculate_expression_tree<Decimal>(Decimal& result_value);
+
+std::expected<std::unique_ptr<Node>, ParseError> try_parse(std::string_view expression)
+{
+    ExpressionScope scope;
+    TraceScope trace("parse");
+
+    // 与えられた式から空白を除去する
+    std::string expression_without_space;
+
+    {
+        PhaseTimer timer(Phase::strip_spaces);
+
+        std::copy_if(
+            expression.begin(),
+            expression.end(),
+            std::back_inserter(expression_without_space),
+            [](char ch) { return ' ' != ch; }
+        );
+
+        Statistics::count(Counter::bytes_copied, expression_without_space.length());
+    }
+
+    // 空白を除去した式を二分木へと分割する
+    // (空白を除去した結果、空の文字列となった場合も不正な式と判断する)
+    return Node::try_parse(std::move(expression_without_space));
+}
+
+std::unique_ptr<Node> parse(std::string_view expression)
+{
+    auto root = try_parse(expression);
+
+    if (!root)
+        throw MalformedExpressionException(root.error().message());
+
+    return std::move(*root);
+}
+
+namespace {
+
+// 式の形(二分木の形)を決める文字、つまり演算子と丸括弧かどうかを返す
+bool is_structural_char(char ch) noexcept
+{
+    return Operators::is_structural(ch);
+}
+
+// 演算子と丸括弧で区切られた文字の並びtermが、数値のリテラルかどうかを返す
+// (数字または小数点で始まり、数字・小数点・指数の記号のみからなるものをリテラルとみなす)
+bool is_numeric_literal(std::string_view term) noexcept
+{
+    auto is_digit = [](char ch) { return '0' <= ch && ch <= '9'; };
+
+    if (term.empty() || !(is_digit(term.front()) || '.' == term.front()))
+        return false;
+
+    return std::all_of(term.begin(), term.end(), [&is_digit](char ch) {
+        return is_digit(ch) || '.' == ch || 'e' == ch || 'E' == ch;
+    });
+}
+
+} // namespace
+
+ShapeCache::ShapeCache(std::size_t capacity, std::uint64_t compile_threshold)
+    : capacity(capacity), compile_threshold(compile_threshold)
+{
+}
+
+bool ShapeCache::canonicalize(std::string_view expression, std::string& shape, std::vector<std::string_view>* literals)
+{
+    if (std::string_view::npos != expression.find(placeholder))
+        return false;
+
+    shape.clear();
+    shape.reserve(expression.length());
+
+    for (std::string_view::size_type pos = 0; pos < expression.length(); ) {
+        if (is_structural_char(expression[pos])) {
+            // 演算子と丸括弧はそのまま形状とする
+            shape += expression[pos++];
+            continue;
+        }
+
+        // 次の演算子または丸括弧までを1つの並びとして切り出す
+        auto end = pos;
+
+        while (end < expression.length() && !is_structural_char(expression[end])) {
+            end++;
+        }
+
+        auto term = expression.substr(pos, end - pos);
+
+        if (is_numeric_literal(term)) {
+            // 数値のリテラルはプレースホルダに置き換える
+            shape += placeholder;
+
+            if (literals)
+                literals->push_back(term);
+        }
+        else {
+            // 記号などはそのまま形状の一部とする
+            shape += term;
+        }
+
+        pos = end;
+    }
+
+    return true;
+}
+
+std::unique_ptr<Node> ShapeCache::make_template(const Node& node)
+{
+    auto copy = std::unique_ptr<Node>(new Node());
+
+    if (node.left && node.right) {
+        copy->expression = node.expression;
+        copy->left = make_template(*node.left);
+        copy->right = make_template(*node.right);
+    }
+    else {
+        // 項は、式全体と同じ規則で形状に置き換える
+        // (項は式全体を演算子と丸括弧の位置で区切った部分であるため、式全体の形状の一部と一致する)
+        canonicalize(node.expression, copy->expression, nullptr);
+    }
+
+    return copy;
+}
+
+std::unique_ptr<Node> ShapeCache::instantiate(const Node& node, std::vector<std::string_view>::const_iterator& next)
+{
+    auto copy = std::unique_ptr<Node>(new Node());
+
+    Statistics::count(Counter::nodes_created);
+
+    if (node.left && node.right) {
+        // 左右の部分木の項は、式中でのリテラルの出現順に並んでいるため、左側から順に当てはめる
+        copy->expression = node.expression;
+        copy->left = instantiate(*node.left, next);
+        copy->right = instantiate(*node.right, next);
+    }
+    else {
+        for (auto ch : node.expression) {
+            if (placeholder == ch)
+                copy->expression += *next++;
+            else
+                copy->expression += ch;
+        }
+    }
+
+    Statistics::count(Counter::bytes_copied, copy->expression.length());
+
+    return copy;
+}
+
+std::unique_ptr<Node> ShapeCache::find(const std::string& expression, std::optional<double>* result_value)
+{
+    std::string key;
+    std::vector<std::string_view> literals;
+    std::shared_ptr<Shape> shape = nullptr;
+
+    if (canonicalize(expression, key, &literals)) {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+
+        if (auto it = shapes.find(key); shapes.end() != it)
+            shape = it->second;
+    }
+
+    if (!shape) {
+        miss_count.fetch_add(1, std::memory_order_relaxed);
+        Statistics::count(Counter::shape_cache_misses);
+        return nullptr;
+    }
+
+    hit_count.fetch_add(1, std::memory_order_relaxed);
+    Statistics::count(Counter::shape_cache_hits);
+
+    // ひな形の複製は、ロックを解放した後に行う
+    // (ひな形は変更されず、形状が破棄された場合もshapeが参照している間は解放されない)
+    std::unique_ptr<Node> root;
+
+    {
+        PhaseTimer timer(Phase::parse);
+
+        auto next = literals.cbegin();
+
+        root = instantiate(*shape->tree, next);
+    }
+
+    if (result_value)
+        *result_value = evaluate(*shape, literals);
+
+    return root;
+}
+
+std::optional<double> ShapeCache::evaluate(Shape& shape, const std::vector<std::string_view>& literals)
+{
+    if (0 == compile_threshold)
+        return std::nullopt;
+
+    if (compile_threshold == shape.evaluations.fetch_add(1, std::memory_order_relaxed)) {
+        // 計算しようとした回数がしきい値を超えた時点で、そのスレッドで機械語に変換する
+        // (変換を終えるまでの間や、変換できなかった場合は、二分木で計算する)
+        shape.compiled = CompiledExpression::compile(*shape.tree);
+        shape.compiled_ready.store(true, std::memory_order_release);
+
+        if (shape.compiled) {
+            compilation_count.fetch_add(1, std::memory_order_relaxed);
+            Statistics::count(Counter::jit_compilations);
+        }
+    }
+
+    if (!shape.compiled_ready.load(std::memory_order_acquire) || !shape.compiled)
+        return std::nullopt;
+
+    PhaseTimer timer(Phase::calculate);
+
+    std::vector<double> values;
+
+    values.reserve(literals.size());
+
+    for (auto literal : literals) {
+        double value;
+        auto [ptr, ec] = std::from_chars(literal.data(), literal.data() + literal.length(), value);
+
+        // 範囲外の値など、有限の値として変換できないリテラルを含む場合は二分木で計算する
+        // (parse_numberはこれらを変換できたものとして扱うため、同じ値となることを保証できない)
+        if (std::errc() != ec || literal.data() + literal.length() != ptr || !std::isfinite(value))
+            return std::nullopt;
+
+        values.push_back(value);
+    }
+
+    double result;
+
+    if (!shape.compiled->evaluate(values.data(), result))
+        return std::nullopt;
+
+    compiled_evaluation_count.fetch_add(1, std::memory_order_relaxed);
+    Statistics::count(Counter::jit_evaluations);
+
+    return result;
+}
+
+void ShapeCache::add(const std::string& expression, const Node& root)
+{
+    std::string key;
+
+    if (0 == capacity || !canonicalize(expression, key, nullptr))
+        return;
+
+    auto shape = std::make_shared<Shape>();
+
+    shape->tree = make_template(root);
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    // 他のスレッドが同じ形状を先に追加していた場合は、既にある形状(計算回数や変換した機械語)をそのまま保持する
+    if (!shapes.try_emplace(key, std::move(shape)).second)
+        return;
+
+    insertion_order.push_back(std::move(key));
+
+    // 保持する形状の数がcapacityを超えた場合は、最も古く追加された形状を破棄する
+    // (破棄した形状を参照しているスレッドがある間は、その形状の情報は解放されない)
+    if (capacity < shapes.size()) {
+        shapes.erase(insertion_order.front());
+        insertion_order.pop_front();
+    }
+}
+
+std::unique_ptr<Node> ShapeCache::parse(const std::string& expression)
+{
+    if (auto root = find(expression))
+        return root;
+
+    auto root = std::make_unique<Node>(expression);
+
+    root->parse_expression();
+
+    add(expression, *root);
+
+    return root;
+}
+
+int process_expression(
+    std::string_view input,
+    std::ostream& output,
+    std::ostream& error,
+    const std::function<bool(Node&, const std::string&)>& on_parsed,
+    ShapeCache* shape_cache
+)
+{
+    ExpressionScope scope;
+    TraceScope trace("expression", TraceArgument::sequence);
+
+    // 与えられた式から空白を除去する
+    std::string expression;
+
+    {
+        PhaseTimer timer(Phase::strip_spaces);
+
+        expression = std::string(input);
+        expression.erase(
+            std::remove(expression.begin(), expression.end(), ' '),
+            expression.end()
+        );
+
+        Statistics::count(Counter::bytes_copied, input.length());
+    }
+
+    if (0 == expression.length())
+        // 空白を除去した結果、空の文字列となった場合は、処理を終了する
+        return 1;
+
+    std::unique_ptr<Node> root = nullptr;
+    std::optional<double> compiled_result; // 機械語に変換した形状で計算した式の値
+
+    {
+        TraceScope trace("parse");
+
+        // キャッシュに同じ形状の式がある場合は、その二分木を再利用する
+        if (shape_cache)
+            root = shape_cache->find(expression, &compiled_result);
+
+        if (root) {
+            output << "expression: " << expression << std::endl;
+        }
+        else {
+            // 不正な式が多く与えられる場合に備え、例外を送出しない方法で二分木へと分割する
+            auto parsed = Node::try_parse(expression);
+
+            // 括弧の対応が取れていない場合以外は、式を表示してから結果を表示する
+            // (根ノードの作成時に括弧の対応を検証し、その後に式を表示して分割する場合と同じ出力とする)
+            if (parsed || ParseErrorCode::unbalanced_bracket != parsed.error().code)
+                output << "expression: " << expression << std::endl;
+
+            if (!parsed) {
+                error << parsed.error().message() << std::endl;
+                return 1;
+            }
+
+            root = std::move(*parsed);
+
+            if (shape_cache)
+                shape_cache->add(expression, *root);
+        }
+    }
+
+    if (on_parsed && !on_parsed(*root, expression))
+        // 分割した二分木に対する処理が中止された場合は、処理を終了する
+        return 1;
+
+    {
+        // 分割した二分木を帰りがけ順で巡回して表示する(前置記法/逆ポーランド記法で表示される)
+        TraceScope trace("write_postorder");
+
+        output << "reverse polish notation: ";
+        root->write_postorder(output);
+        output << std::endl;
+    }
+
+    {
+        // 分割した二分木を通りがけ順で巡回して表示する(中置記法で表示される)
+        TraceScope trace("write_inorder");
+
+        output << "infix notation: ";
+        root->write_inorder(output);
+        output << std::endl;
+    }
+
+    {
+        // 分割した二分木を行きがけ順で巡回して表示する(後置記法/ポーランド記法で表示される)
+        TraceScope trace("write_preorder");
+
+        output << "polish notation: ";
+        root->write_preorder(output);
+        output << std::endl;
+    }
+
+    // 分割した二分木から式全体の値を計算する
+    double result_value;
+    bool calculated;
+
+    {
+        TraceScope trace("calculate");
+
+        if (compiled_result) {
+            // 機械語で計算できた場合は、その値を用いる(二分木で計算した場合と同じ値となる)
+            result_value = *compiled_result;
+            calculated = true;
+        }
+        else {
+            calculated = root->calculate_expression_tree(result_value);
+        }
+    }
+
+    if (calculated) {
+        // 計算できた場合はその値を表示する
+        output << "calculated result: " << Node::format_number(result_value) << std::endl;
+        return 0;
+    }
+    else {
+        // (式の一部あるいは全部が)計算できなかった場合は、計算結果の式を中置記法で表示する
+        output << "calculated expression: ";
+        root->write_inorder(output);
+        output << std::endl;
+        return 2;
+    }
+}
+
+void ExpressionTreeImage::save(Node& root, const std::string_view& expression, std::ostream& stream)
+{
+    std::vector<Literal> literal_table;
+    std::vector<NodeEntry> node_array;
+    std::vector<StringReference> symbol_table;
+    std::string string_table;
+
+    // 文字列を文字列表に追加し、その位置を返す
+    auto add_string = [&string_table](const std::string_view& str) {
+        auto reference = StringReference {
+            static_cast<std::uint32_t>(string_table.length()),
+            static_cast<std::uint32_t>(str.length())
+        };
+
+        string_table += str;
+
+        return reference;
+    };
+
+    auto expression_reference = add_string(expression);
+
+    // 帰りがけ順に巡回してノード配列を構築する
+    // (帰りがけ順では子ノードが親ノードより先に追加されるため、未接続の部分木の根のインデックスをスタックに保持しておく)
+    std::vector<std::uint32_t> subtree_indices;
+
+    root.traverse(
+        nullptr, // ノードへの行きがけには何もしない
+        nullptr, // ノードの通りがけには何もしない
+        [&](Node& node) {
+            auto entry = NodeEntry {};
+            double value = 0.0;
+
+            if (node.left && node.right) {
+                // 左右に子ノードを持つ場合は演算子のノードとし、直前に追加された2つの部分木を左右の子ノードとする
+                entry.kind = NodeKind::operator_node;
+                entry.operator_char = node.expression.front();
+                entry.right = subtree_indices.back();
+                subtree_indices.pop_back();
+                entry.left = subtree_indices.back();
+                subtree_indices.pop_back();
+            }
+            else if (Node::parse_number(node.expression, value)) {
+                // 数値として扱える項の場合は、数値化した値をリテラル表に追加する
+                entry.kind = NodeKind::literal;
+                entry.table_index = static_cast<std::uint32_t>(literal_table.size());
+                literal_table.push_back(Literal { value, add_string(node.expression) });
+            }
+            else {
+                // 数値として扱えない項の場合は、シンボル表に追加する
+                entry.kind = NodeKind::symbol;
+                entry.table_index = static_cast<std::uint32_t>(symbol_table.size());
+                symbol_table.push_back(add_string(node.expression));
+            }
+
+            subtree_indices.push_back(static_cast<std::uint32_t>(node_array.size()));
+            node_array.push_back(entry);
+        }
+    );
+
+    // ヘッダ以降の部分を構築する
+    std::string body;
+
+    body.append(reinterpret_cast<const char*>(literal_table.data()), literal_table.size() * sizeof(Literal));
+    body.append(reinterpret_cast<const char*>(node_array.data()), node_array.size() * sizeof(NodeEntry));
+    body.append(reinterpret_cast<const char*>(symbol_table.data()), symbol_table.size() * sizeof(StringReference));
+    body.append(string_table);
+
+    auto header = Header {};
+
+    std::copy(std::begin(magic), std::end(magic), header.magic);
+    header.version = format_version;
+    header.node_count = static_cast<std::uint32_t>(node_array.size());
+    header.literal_count = static_cast<std::uint32_t>(literal_table.size());
+    header.symbol_count = static_cast<std::uint32_t>(symbol_table.size());
+    header.string_table_length = static_cast<std::uint32_t>(string_table.length());
+    header.expression = expression_reference;
+    header.checksum = calculate_checksum(body.data(), body.length());
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    stream.write(body.data(), body.length());
+}
+
+ExpressionTreeImage ExpressionTreeImage::load(const void* data, std::size_t length)
+{
+    auto bytes = static_cast<const char*>(data);
+
+    if (length < sizeof(Header))
+        throw MalformedTreeImageException("tree image is too short");
+
+    auto header = reinterpret_cast<const Header*>(bytes);
+
+    if (!std::equal(std::begin(magic), std::end(magic), header->magic))
+        throw MalformedTreeImageException("not a tree image");
+
+    if (format_version != header->version)
+        throw MalformedTreeImageException(std::format("unsupported tree image version: {}", header->version));
+
+    // 各部分の要素数から求められる長さと、実際の長さが一致するか検証する
+    auto expected_length =
+        sizeof(Header) +
+        static_cast<std::uint64_t>(header->literal_count) * sizeof(Literal) +
+        static_cast<std::uint64_t>(header->node_count) * sizeof(NodeEntry) +
+        static_cast<std::uint64_t>(header->symbol_count) * sizeof(StringReference) +
+        header->string_table_length;
+
+    if (expected_length != length)
+        throw MalformedTreeImageException("tree image length mismatch");
+
+    if (header->checksum != calculate_checksum(bytes + sizeof(Header), length - sizeof(Header)))
+        throw MalformedTreeImageException("tree image checksum mismatch");
+
+    if (0 == header->node_count)
+        throw MalformedTreeImageException("tree image has no nodes");
+
+    auto image = ExpressionTreeImage(bytes);
+
+    // 文字列の位置が文字列表の範囲内にあるか検証する
+    auto validate_string = [&header](const StringReference& reference) {
+        if (header->string_table_length < static_cast<std::uint64_t>(reference.offset) + reference.length)
+            throw MalformedTreeImageException("string out of range in tree image");
+    };
+
+    validate_string(header->expression);
+
+    for (std::uint32_t i = 0; i < header->literal_count; i++) {
+        validate_string(image.literals[i].text);
+    }
+
+    for (std::uint32_t i = 0; i < header->symbol_count; i++) {
+        validate_string(image.symbols[i]);
+    }
+
+    // 各ノードが参照するインデックスを検証する
+    // (子ノードは帰りがけ順で親ノードより前にあるはずなので、そうでないものは循環を含む不正なイメージと判断する)
+    for (std::uint32_t i = 0; i < header->node_count; i++) {
+        auto& node = image.nodes[i];
+        auto valid = false;
+
+        switch (node.kind) {
+            case NodeKind::operator_node: valid = node.left < i && node.right < i; break;
+            case NodeKind::literal: valid = node.table_index < header->literal_count; break;
+            case NodeKind::symbol: valid = node.table_index < header->symbol_count; break;
+        }
+
+        if (!valid)
+            throw MalformedTreeImageException(std::format("invalid node in tree image: {}", i));
+    }
+
+    return image;
+}
+
+ExpressionTreeImage::ExpressionTreeImage(const char* data) noexcept
+{
+    header = reinterpret_cast<const Header*>(data);
+    literals = reinterpret_cast<const Literal*>(data + sizeof(Header));
+    nodes = reinterpret_cast<const NodeEntry*>(literals + header->literal_count);
+    symbols = reinterpret_cast<const StringReference*>(nodes + header->node_count);
+    strings = reinterpret_cast<const char*>(symbols + header->symbol_count);
+}
+
+std::uint32_t ExpressionTreeImage::calculate_checksum(const char* data, std::size_t length) noexcept
+{
+    // FNV-1a(32ビット)でハッシュ値を計算する
+    std::uint32_t hash = 2166136261u;
+
+    for (std::size_t i = 0; i < length; i++) {
+        hash ^= static_cast<std::uint8_t>(data[i]);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+std::string_view ExpressionTreeImage::expression() const noexcept
+{
+    return std::string_view(strings + header->expression.offset, header->expression.length);
+}
+
+std::string_view ExpressionTreeImage::text_of(const NodeEntry& node) const noexcept
+{
+    switch (node.kind) {
+        case NodeKind::literal:
+            return std::string_view(strings + literals[node.table_index].text.offset, literals[node.table_index].text.length);
+        case NodeKind::symbol:
+            return std::string_view(strings + symbols[node.table_index].offset, symbols[node.table_index].length);
+        default:
+            return std::string_view(&node.operator_char, 1);
+    }
+}
+
+void ExpressionTreeImage::traverse(
+    std::uint32_t index,
+    const std::function<void(const NodeEntry&)>& on_visit,
+    const std::function<void(const NodeEntry&)>& on_transit,
+    const std::function<void(const NodeEntry&)>& on_leave
+) const
+{
+    auto& node = nodes[index];
+    auto has_children = NodeKind::operator_node == node.kind;
+
+    if (on_visit)
+        on_visit(node);
+
+    if (has_children)
+        traverse(node.left, on_visit, on_transit, on_leave);
+
+    if (on_transit)
+        on_transit(node);
+
+    if (has_children)
+        traverse(node.right, on_visit, on_transit, on_leave);
+
+    if (on_leave)
+        on_leave(node);
+}
+
+void ExpressionTreeImage::write_postorder(std::ostream& stream) const
+{
+    traverse(
+        root_index(),
+        nullptr,
+        nullptr,
+        [this, &stream](const NodeEntry& node) { stream << text_of(node) << ' '; }
+    );
+}
+
+void ExpressionTreeImage::write_inorder(std::ostream& stream) const
+{
+    traverse(
+        root_index(),
+        [&stream](const NodeEntry& node) {
+            if (NodeKind::operator_node == node.kind)
+                stream << '(';
+        },
+        [this, &stream](const NodeEntry& node) {
+            if (NodeKind::operator_node == node.kind)
+                stream << ' ' << text_of(node) << ' ';
+            else
+                stream << text_of(node);
+        },
+        [&stream](const NodeEntry& node) {
+            if (NodeKind::operator_node == node.kind)
+                stream << ')';
+        }
+    );
+}
+
+void ExpressionTreeImage::write_preorder(std::ostream& stream) const
+{
+    traverse(
+        root_index(),
+        [this, &stream](const NodeEntry& node) { stream << text_of(node) << ' '; },
+        nullptr,
+        nullptr
+    );
+}
+
+std::vector<std::optional<double>> ExpressionTreeImage::calculate_nodes() const
+{
+    std::vector<std::optional<double>> values(header->node_count);
+
+    // ノード配列は帰りがけ順に並んでいるため、先頭から順に計算すれば子ノードの値は常に計算済みとなる
+    for (std::uint32_t i = 0; i < header->node_count; i++) {
+        auto& node = nodes[i];
+
+        if (NodeKind::literal == node.kind) {
+            // 数値として扱える項の場合は、その値をノードの値とする
+            values[i] = literals[node.table_index].value;
+            continue;
+        }
+
+        // 数値として扱えない項、または左右の子ノードのどちらかが計算できない場合は、計算できないものとして扱う
+        if (NodeKind::operator_node != node.kind || !values[node.left] || !values[node.right])
+            continue;
+
+        auto left_operand = *values[node.left];
+        auto right_operand = *values[node.right];
+
+        // 演算できない演算子の場合は計算できないものとして扱う
+        if (double result; Operators::evaluate(node.operator_char, left_operand, right_operand, result))
+            values[i] = result;
+    }
+
+    return values;
+}
+
+bool ExpressionTreeImage::calculate_expression_tree(double& result_value) const
+{
+    auto values = calculate_nodes();
+
+    if (!values[root_index()])
+        return false;
+
+    result_value = *values[root_index()];
+
+    return true;
+}
+
+void ExpressionTreeImage::write_calculated_inorder(std::ostream& stream) const
+{
+    auto values = calculate_nodes();
+
+    // 計算できた演算子のノードはその値を、それ以外のノードは演算子または項を出力する
+    std::function<void(std::uint32_t)> write_node = [&](std::uint32_t index) {
+        auto& node = nodes[index];
+
+        if (NodeKind::operator_node != node.kind) {
+            stream << text_of(node);
+        }
+        else if (values[index]) {
+            stream << Node::format_number(*values[index]);
+        }
+        else {
+            stream << '(';
+            write_node(node.left);
+            stream << ' ' << text_of(node) << ' ';
+            write_node(node.right);
+            stream << ')';
+        }
+    };
+
+    write_node(root_index());
+}
+
+namespace {
+
+// スレッドごとの記録
+// 記録を更新するのは所有するスレッドのみで、他のスレッドは集計時に読み取るのみとする
+// (そのため、更新には不可分な加算ではなく、読み取りと書き込みを個別に行う)
+struct ThreadStatistics {
+    std::array<std::atomic<std::uint64_t>, phase_count> phase_calls {};
+    std::array<std::atomic<std::uint64_t>, phase_count> phase_nanoseconds {};
+    std::array<std::atomic<std::uint64_t>, counter_count> counters {};
+    std::array<bool, phase_count> active_phases {}; // 計測中の処理
+
+    ThreadStatistics();
+    ~ThreadStatistics();
+};
+
+// 記録を行っているスレッドの一覧と、終了したスレッドの記録
+struct StatisticsRegistry {
+    std::mutex mutex;
+    std::vector<ThreadStatistics*> threads;
+    StatisticsSnapshot retired;
+};
+
+StatisticsRegistry& statistics_registry()
+{
+    // スレッドの終了時にも参照するため、破棄せずに保持し続ける
+    static auto registry = new StatisticsRegistry();
+
+    return *registry;
+}
+
+ThreadStatistics::ThreadStatistics()
+{
+    auto& registry = statistics_registry();
+    std::lock_guard lock(registry.mutex);
+
+    registry.threads.push_back(this);
+}
+
+ThreadStatistics::~ThreadStatistics()
+{
+    auto& registry = statistics_registry();
+    std::lock_guard lock(registry.mutex);
+
+    // 終了するスレッドの記録を、終了したスレッドの記録に加える
+    for (std::size_t i = 0; i < phase_count; i++) {
+        registry.retired.phase_calls[i] += phase_calls[i].load(std::memory_order_relaxed);
+        registry.retired.phase_nanoseconds[i] += phase_nanoseconds[i].load(std::memory_order_relaxed);
+    }
+
+    for (std::size_t i = 0; i < counter_count; i++) {
+        registry.retired.counters[i] += counters[i].load(std::memory_order_relaxed);
+    }
+
+    std::erase(registry.threads, this);
+}
+
+thread_local ThreadStatistics thread_statistics;
+
+void add_relaxed(std::atomic<std::uint64_t>& value, std::uint64_t addend) noexcept
+{
+    value.store(value.load(std::memory_order_relaxed) + addend, std::memory_order_relaxed);
+}
+
+// 複数のスレッドから更新される値valueを、candidateとの大きい方に更新する
+void update_max(std::atomic<std::uint64_t>& value, std::uint64_t candidate) noexcept
+{
+    auto current = value.load(std::memory_order_relaxed);
+
+    while (current < candidate && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {
+    }
+}
+
+// メモリの確保の記録
+// operator newから呼び出されるため、スレッドごとの記録(ThreadStatistics)のように
+// 構築時にメモリを確保するものは用いず、定数で初期化できるもののみで構成する
+struct AllocationStatistics {
+    std::array<std::atomic<std::uint64_t>, phase_count + 1> allocations {};
+    std::array<std::atomic<std::uint64_t>, phase_count + 1> allocated_bytes {};
+    std::array<std::atomic<std::uint64_t>, phase_count + 1> peak_live_bytes {};
+    std::atomic<std::uint64_t> expressions {};
+    std::atomic<std::uint64_t> expression_max_allocations {};
+    std::atomic<std::uint64_t> expression_max_allocated_bytes {};
+    std::atomic<std::uint64_t> expression_max_peak_live_bytes {};
+};
+
+constinit AllocationStatistics allocation_statistics;
+
+// スレッドごとのメモリの確保の状態
+struct AllocationTracker {
+    std::size_t phase = phase_count;            // 計測中の処理(ない場合はphase_count)
+    bool in_expression = false;                 // 式の処理中かどうか
+    std::int64_t live_bytes = 0;                // 確保中のメモリの量(他のスレッドで確保された領域を解放した場合は負になりうる)
+    std::int64_t max_live_bytes = 0;            // 計測中の処理の開始以降での、live_bytesの最大値
+    std::int64_t expression_max_live_bytes = 0; // 式の処理の開始以降での、live_bytesの最大値
+    std::uint64_t allocations = 0;              // 確保した回数の累計
+    std::uint64_t allocated_bytes = 0;          // 確保した量の累計
+};
+
+constinit thread_local AllocationTracker allocation_tracker;
+
+} // namespace
+
+void Statistics::add_count(Counter counter, std::uint64_t count) noexcept
+{
+    add_relaxed(thread_statistics.counters[static_cast<std::size_t>(counter)], count);
+}
+
+bool Statistics::enter_phase(Phase phase, AllocationScope& scope) noexcept
+{
+    auto& active = thread_statistics.active_phases[static_cast<std::size_t>(phase)];
+
+    if (active)
+        return false;
+
+    active = true;
+
+    // 外側の処理の状態を保存し、以降の確保をこの処理に対するものとして記録する
+    auto& tracker = allocation_tracker;
+
+    scope.outer_phase = tracker.phase;
+    scope.live_bytes = tracker.live_bytes;
+    scope.outer_max_live_bytes = tracker.max_live_bytes;
+
+    tracker.phase = static_cast<std::size_t>(phase);
+    tracker.max_live_bytes = tracker.live_bytes;
+
+    return true;
+}
+
+void Statistics::leave_phase(Phase phase, std::chrono::steady_clock::duration elapsed, const AllocationScope& scope) noexcept
+{
+    auto index = static_cast<std::size_t>(phase);
+
+    thread_statistics.active_phases[index] = false;
+
+    // この処理での確保中のメモリの量の最大値を記録し、外側の処理の状態に戻す
+    // (この処理での最大値は、外側の処理での最大値にも含める)
+    auto& tracker = allocation_tracker;
+
+    update_max(allocation_statistics.peak_live_bytes[index], std::max<std::int64_t>(0, tracker.max_live_bytes - scope.live_bytes));
+
+    tracker.phase = scope.outer_phase;
+    tracker.max_live_bytes = std::max(scope.outer_max_live_bytes, tracker.max_live_bytes);
+
+    add_relaxed(thread_statistics.phase_calls[index], 1);
+    add_relaxed(
+        thread_statistics.phase_nanoseconds[index],
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()
+    );
+}
+
+bool Statistics::enter_expression(AllocationScope& scope) noexcept
+{
+    auto& tracker = allocation_tracker;
+
+    if (tracker.in_expression)
+        return false;
+
+    tracker.in_expression = true;
+    tracker.expression_max_live_bytes = tracker.live_bytes;
+
+    scope.live_bytes = tracker.live_bytes;
+    scope.allocations = tracker.allocations;
+    scope.allocated_bytes = tracker.allocated_bytes;
+
+    return true;
+}
+
+void Statistics::leave_expression(const AllocationScope& scope) noexcept
+{
+    auto& tracker = allocation_tracker;
+
+    tracker.in_expression = false;
+
+    allocation_statistics.expressions.fetch_add(1, std::memory_order_relaxed);
+
+    update_max(allocation_statistics.expression_max_allocations, tracker.allocations - scope.allocations);
+    update_max(allocation_statistics.expression_max_allocated_bytes, tracker.allocated_bytes - scope.allocated_bytes);
+    update_max(
+        allocation_statistics.expression_max_peak_live_bytes,
+        std::max<std::int64_t>(0, tracker.expression_max_live_bytes - scope.live_bytes)
+    );
+}
+
+void Statistics::record_allocation(std::size_t size) noexcept
+{
+    auto& tracker = allocation_tracker;
+
+    tracker.allocations++;
+    tracker.allocated_bytes += size;
+    tracker.live_bytes += size;
+    tracker.max_live_bytes = std::max(tracker.max_live_bytes, tracker.live_bytes);
+    tracker.expression_max_live_bytes = std::max(tracker.expression_max_live_bytes, tracker.live_bytes);
+
+    // 確保した回数と量は、複数のスレッドで同じ処理を行う場合があるため、不可分な加算で記録する
+    allocation_statistics.allocations[tracker.phase].fetch_add(1, std::memory_order_relaxed);
+    allocation_statistics.allocated_bytes[tracker.phase].fetch_add(size, std::memory_order_relaxed);
+}
+
+void Statistics::record_deallocation(std::size_t size) noexcept
+{
+    allocation_tracker.live_bytes -= size;
+}
+
+StatisticsSnapshot Statistics::snapshot()
+{
+    auto& registry = statistics_registry();
+    std::lock_guard lock(registry.mutex);
+
+    auto snapshot = registry.retired;
+
+    for (auto thread : registry.threads) {
+        for (std::size_t i = 0; i < phase_count; i++) {
+            snapshot.phase_calls[i] += thread->phase_calls[i].load(std::memory_order_relaxed);
+            snapshot.phase_nanoseconds[i] += thread->phase_nanoseconds[i].load(std::memory_order_relaxed);
+        }
+
+        for (std::size_t i = 0; i < counter_count; i++) {
+            snapshot.counters[i] += thread->counters[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    for (std::size_t i = 0; i <= phase_count; i++) {
+        snapshot.phase_allocations[i] = allocation_statistics.allocations[i].load(std::memory_order_relaxed);
+        snapshot.phase_allocated_bytes[i] = allocation_statistics.allocated_bytes[i].load(std::memory_order_relaxed);
+        snapshot.phase_peak_live_bytes[i] = allocation_statistics.peak_live_bytes[i].load(std::memory_order_relaxed);
+    }
+
+    snapshot.expressions = allocation_statistics.expressions.load(std::memory_order_relaxed);
+    snapshot.expression_max_allocations = allocation_statistics.expression_max_allocations.load(std::memory_order_relaxed);
+    snapshot.expression_max_allocated_bytes = allocation_statistics.expression_max_allocated_bytes.load(std::memory_order_relaxed);
+    snapshot.expression_max_peak_live_bytes = allocation_statistics.expression_max_peak_live_bytes.load(std::memory_order_relaxed);
+
+    return snapshot;
+}
+
+void Statistics::reset()
+{
+    auto& registry = statistics_registry();
+    std::lock_guard lock(registry.mutex);
+
+    registry.retired = StatisticsSnapshot();
+
+    for (auto thread : registry.threads) {
+        for (auto& value : thread->phase_calls) value.store(0, std::memory_order_relaxed);
+        for (auto& value : thread->phase_nanoseconds) value.store(0, std::memory_order_relaxed);
+        for (auto& value : thread->counters) value.store(0, std::memory_order_relaxed);
+    }
+
+    for (auto& value : allocation_statistics.allocations) value.store(0, std::memory_order_relaxed);
+    for (auto& value : allocation_statistics.allocated_bytes) value.store(0, std::memory_order_relaxed);
+    for (auto& value : allocation_statistics.peak_live_bytes) value.store(0, std::memory_order_relaxed);
+
+    allocation_statistics.expressions.store(0, std::memory_order_relaxed);
+    allocation_statistics.expression_max_allocations.store(0, std::memory_order_relaxed);
+    allocation_statistics.expression_max_allocated_bytes.store(0, std::memory_order_relaxed);
+    allocation_statistics.expression_max_peak_live_bytes.store(0, std::memory_order_relaxed);
+}
+
+std::string_view Statistics::name_of(Phase phase) noexcept
+{
+    switch (phase) {
+        case Phase::strip_spaces: return "strip_spaces";
+        case Phase::validate_bracket: return "validate_bracket";
+        case Phase::parse: return "parse";
+        case Phase::write_postorder: return "write_postorder";
+        case Phase::write_inorder: return "write_inorder";
+        case Phase::write_preorder: return "write_preorder";
+        case Phase::calculate: return "calculate";
+        default: return "unknown";
+    }
+}
+
+std::string_view Statistics::name_of(Counter counter) noexcept
+{
+    switch (counter) {
+        case Counter::nodes_created: return "nodes_created";
+        case Counter::bytes_copied: return "bytes_copied";
+        case Counter::parse_number_calls: return "parse_number_calls";
+        case Counter::format_number_calls: return "format_number_calls";
+        case Counter::integer_operations: return "integer_operations";
+        case Counter::shape_cache_hits: return "shape_cache_hits";
+        case Counter::shape_cache_misses: return "shape_cache_misses";
+        case Counter::jit_compilations: return "jit_compilations";
+        case Counter::jit_evaluations: return "jit_evaluations";
+        case Counter::subtrees_reused: return "subtrees_reused";
+        default: return "unknown";
+    }
+}
+
+namespace {
+
+// メモリの確保を記録したかどうかを返す
+bool allocations_tracked(const StatisticsSnapshot& snapshot) noexcept
+{
+    return std::any_of(snapshot.phase_allocations.begin(), snapshot.phase_allocations.end(), [](auto count) { return 0 < count; });
+}
+
+} // namespace
+
+void Statistics::write_text(std::ostream& stream, const StatisticsSnapshot& snapshot)
+{
+    if (!enabled) {
+        stream << "statistics: not available (built without POLISH_STATS)" << std::endl;
+        return;
+    }
+
+    auto flags = stream.flags();
+    auto precision = stream.precision();
+
+    stream << std::left << std::setw(20) << "phase" << std::right << std::setw(12) << "calls" << std::setw(16) << "time (us)" << std::endl;
+
+    for (std::size_t i = 0; i < phase_count; i++) {
+        stream
+            << std::left << std::setw(20) << name_of(static_cast<Phase>(i))
+            << std::right << std::setw(12) << snapshot.phase_calls[i]
+            << std::setw(16) << std::fixed << std::setprecision(3) << snapshot.phase_nanoseconds[i] / 1e3
+            << std::endl;
+    }
+
+    stream << std::left << std::setw(20) << "counter" << std::right << std::setw(28) << "count" << std::endl;
+
+    for (std::size_t i = 0; i < counter_count; i++) {
+        stream
+            << std::left << std::setw(20) << name_of(static_cast<Counter>(i))
+            << std::right << std::setw(28) << snapshot.counters[i]
+            << std::endl;
+    }
+
+    stream << std::left << std::setw(20) << "expressions" << std::right << std::setw(28) << snapshot.expressions << std::endl;
+
+    // メモリの確保を記録した場合(polish_alloc.cppをリンクした場合)のみ出力する
+    if (allocations_tracked(snapshot)) {
+        stream
+            << std::left << std::setw(20) << "allocation"
+            << std::right << std::setw(12) << "allocations" << std::setw(16) << "bytes" << std::setw(18) << "peak live bytes"
+            << std::endl;
+
+        for (std::size_t i = 0; i <= phase_count; i++) {
+            stream
+                << std::left << std::setw(20) << (i < phase_count ? name_of(static_cast<Phase>(i)) : "outside_phases")
+                << std::right << std::setw(12) << snapshot.phase_allocations[i]
+                << std::setw(16) << snapshot.phase_allocated_bytes[i]
+                << std::setw(18) << snapshot.phase_peak_live_bytes[i]
+                << std::endl;
+        }
+
+        stream
+            << std::left << std::setw(20) << "max per expression"
+            << std::right << std::setw(12) << snapshot.expression_max_allocations
+            << std::setw(16) << snapshot.expression_max_allocated_bytes
+            << std::setw(18) << snapshot.expression_max_peak_live_bytes
+            << std::endl;
+    }
+
+    stream.flags(flags);
+    stream.precision(precision);
+}
+
+void Statistics::write_json(std::ostream& stream, const StatisticsSnapshot& snapshot)
+{
+    stream << "{\"enabled\":" << (enabled ? "true" : "false") << ",\"phases\":{";
+
+    for (std::size_t i = 0; i < phase_count; i++) {
+        stream
+            << (0 < i ? "," : "")
+            << '"' << name_of(static_cast<Phase>(i)) << "\":{"
+            << "\"calls\":" << snapshot.phase_calls[i] << ','
+            << "\"nanoseconds\":" << snapshot.phase_nanoseconds[i]
+            << '}';
+    }
+
+    stream << "},\"counters\":{";
+
+    for (std::size_t i = 0; i < counter_count; i++) {
+        stream << (0 < i ? "," : "") << '"' << name_of(static_cast<Counter>(i)) << "\":" << snapshot.counters[i];
+    }
+
+    stream << "},\"expressions\":" << snapshot.expressions;
+    stream << ",\"allocations\":{\"tracked\":" << (allocations_tracked(snapshot) ? "true" : "false") << ",\"phases\":{";
+
+    for (std::size_t i = 0; i <= phase_count; i++) {
+        stream
+            << (0 < i ? "," : "")
+            << '"' << (i < phase_count ? name_of(static_cast<Phase>(i)) : "outside_phases") << "\":{"
+            << "\"allocations\":" << snapshot.phase_allocations[i] << ','
+            << "\"bytes\":" << snapshot.phase_allocated_bytes[i] << ','
+            << "\"peak_live_bytes\":" << snapshot.phase_peak_live_bytes[i]
+            << '}';
+    }
+
+    stream
+        << "},\"max_per_expression\":{"
+        << "\"allocations\":" << snapshot.expression_max_allocations << ','
+        << "\"bytes\":" << snapshot.expression_max_allocated_bytes << ','
+        << "\"peak_live_bytes\":" << snapshot.expression_max_peak_live_bytes
+        << "}}}" << std::endl;
+}
+
+namespace {
+
+// 記録した処理の開始・終了
+struct TraceEvent {
+    const char* name;
+    std::uint64_t timestamp;    // 記録を開始してからの経過時間(ナノ秒)
+    std::uint64_t sequence;     // 通し番号(TraceArgument::sequenceの場合のみ)
+    char type;                  // 開始の場合は'B'、終了の場合は'E'
+    TraceArgument argument;
+};
+
+// スレッドごとのリングバッファ
+// 書き込むのは所有するスレッドのみで、書き込んだ数writtenを更新することで書き込みを公開する
+struct TraceBuffer {
+    std::vector<TraceEvent> events;
+    std::atomic<std::uint64_t> written = 0;
+    std::uint32_t thread_id;
+    std::string thread_name;
+
+    TraceBuffer(std::size_t capacity, std::uint32_t thread_id)
+        : events(capacity), thread_id(thread_id)
+    {
+    }
+
+    void push(const TraceEvent& event) noexcept
+    {
+        auto count = written.load(std::memory_order_relaxed);
+
+        events[count % events.size()] = event;
+
+        written.store(count + 1, std::memory_order_release);
+    }
+};
+
+// すべてのスレッドのバッファ
+// (スレッドの終了後も記録を出力できるよう、バッファはスレッドではなくここで保持する)
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    std::size_t buffer_capacity = Tracer::default_buffer_capacity;
+    std::chrono::steady_clock::time_point started_at = std::chrono::steady_clock::now();
+    std::atomic<std::uint64_t> next_sequence = 0;
+};
+
+TraceRegistry& trace_registry()
+{
+    // スレッドの終了時にも参照するため、破棄せずに保持し続ける
+    static auto registry = new TraceRegistry();
+
+    return *registry;
+}
+
+constinit thread_local TraceBuffer* thread_trace_buffer = nullptr;
+
+// 現在のスレッドのバッファを返す(初めて記録する場合はバッファを作成する)
+TraceBuffer& current_trace_buffer()
+{
+    if (!thread_trace_buffer) {
+        auto& registry = trace_registry();
+        std::lock_guard lock(registry.mutex);
+
+        registry.buffers.push_back(
+            std::make_unique<TraceBuffer>(registry.buffer_capacity, static_cast<std::uint32_t>(registry.buffers.size() + 1))
+        );
+
+        thread_trace_buffer = registry.buffers.back().get();
+    }
+
+    return *thread_trace_buffer;
+}
+
+std::uint64_t trace_timestamp() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - trace_registry().started_at
+    ).count();
+}
+
+} // namespace
+
+void Tracer::start(std::size_t buffer_capacity)
+{
+    auto& registry = trace_registry();
+
+    {
+        std::lock_guard lock(registry.mutex);
+
+        registry.buffer_capacity = std::max<std::size_t>(1, buffer_capacity);
+    }
+
+    active.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::stop() noexcept
+{
+    active.store(false, std::memory_order_relaxed);
+}
+
+void Tracer::set_thread_name(std::string_view name)
+{
+    if (!enabled())
+        return;
+
+    auto& buffer = current_trace_buffer();
+    std::lock_guard lock(trace_registry().mutex);
+
+    buffer.thread_name = name;
+}
+
+void Tracer::begin(const char* name, TraceArgument argument) noexcept
+{
+    try {
+        auto& buffer = current_trace_buffer();
+        auto sequence = TraceArgument::sequence == argument
+            ? trace_registry().next_sequence.fetch_add(1, std::memory_order_relaxed)
+            : 0;
+
+        buffer.push(TraceEvent { name, trace_timestamp(), sequence, 'B', argument });
+    }
+    catch (...) {
+        // バッファを作成できない場合は記録しない
+    }
+}
+
+void Tracer::end(const char* name) noexcept
+{
+    // 開始を記録したスレッドでは、バッファは作成済みとなる
+    if (thread_trace_buffer)
+        thread_trace_buffer->push(TraceEvent { name, trace_timestamp(), 0, 'E', TraceArgument::none });
+}
+
+void Tracer::write_json(std::ostream& stream)
+{
+    auto& registry = trace_registry();
+    std::lock_guard lock(registry.mutex);
+
+    auto flags = stream.flags();
+    auto precision = stream.precision();
+    auto first = true;
+
+    auto separate = [&]() -> std::ostream& {
+        stream << (first ? "\n" : ",\n");
+        first = false;
+        return stream;
+    };
+
+    stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    for (auto& buffer : registry.buffers) {
+        if (!buffer->thread_name.empty()) {
+            // スレッドの名前は、JSONの文字列として出力できるものに限定する
+            std::string thread_name;
+
+            std::copy_if(
+                buffer->thread_name.begin(),
+                buffer->thread_name.end(),
+                std::back_inserter(thread_name),
+                [](char ch) { return 0x20 <= ch && '"' != ch && '\\' != ch; }
+            );
+
+            separate()
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_id
+                << ",\"args\":{\"name\":\"" << thread_name << "\"}}";
+        }
+
+        auto written = buffer->written.load(std::memory_order_acquire);
+        auto capacity = static_cast<std::uint64_t>(buffer->events.size());
+        auto depth = 0;
+
+        // リングバッファが一周している場合は、上書きされずに残っているもののみを出力する
+        // (開始が上書きされた終了は出力しない)
+        for (auto i = capacity < written ? written - capacity : 0; i < written; i++) {
+            auto& event = buffer->events[i % capacity];
+
+            if ('E' == event.type) {
+                if (0 == depth)
+                    continue;
+
+                depth--;
+            }
+            else {
+                depth++;
+            }
+
+            separate()
+                << "{\"name\":\"" << event.name << "\",\"cat\":\"polish\",\"ph\":\"" << event.type
+                << "\",\"ts\":" << std::fixed << std::setprecision(3) << event.timestamp / 1e3
+                << ",\"pid\":1,\"tid\":" << buffer->thread_id;
+
+            if (TraceArgument::sequence == event.argument)
+                stream << ",\"args\":{\"sequence\":" << event.sequence << '}';
+
+            stream << '}';
+        }
+    }
+
+    stream << "\n]}" << std::endl;
+
+    stream.flags(flags);
+    stream.precision(precision);
+}
+
+#if defined(_WIN32)
+MappedFile::MappedFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file)
+        throw std::runtime_error(std::format("cannot open file: {}", path));
+
+    buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+MappedFile::~MappedFile() = default;
+
+const void* MappedFile::data() const noexcept { return buffer.data(); }
+std::size_t MappedFile::size() const noexcept { return buffer.size(); }
+#else
+MappedFile::MappedFile(const std::string& path)
+{
+    auto fd = ::open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        throw std::runtime_error(std::format("cannot open file: {}", path));
+
+    struct stat st;
+
+    if (0 != ::fstat(fd, &st)) {
+        ::close(fd);
+        throw std::runtime_error(std::format("cannot stat file: {}", path));
+    }
+
+    length = static_cast<std::size_t>(st.st_size);
+
+    // 空のファイルはマップできないため、長さ0の領域として扱う
+    if (0 < length) {
+        address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (MAP_FAILED == address) {
+            address = nullptr;
+            ::close(fd);
+            throw std::runtime_error(std::format("cannot map file: {}", path));
+        }
+    }
+
+    // マップした領域はファイルを閉じた後も有効となる
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (address)
+        ::munmap(address, length);
+}
+
+const void* MappedFile::data() const noexcept { return address; }
+std::size_t MappedFile::size() const noexcept { return length; }
+#endif
+
+} // namespace polish
@@ -0,0 +1,571 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// 二分木を使った数式の逆ポーランド記法化と計算を行うライブラリ(libpolish)のヘッダ
+//
+// 使用例:
+//   auto root = polish::parse("(1 + 2) * 3");
+//
+//   root->write_postorder(std::cout); // "1 2 + 3 * "
+//
+//   double result_value;
+//
+//   if (root->calculate_expression_tree(result_value))
+//       std::cout << polish::Node::format_number(result_value); // "9"
+//
+// 不正な式が与えられた場合はMalformedExpressionExceptionを送出する
+// (try_parseを用いた場合は、例外を送出せずにエラー(ParseError)を返す)
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <expected>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "polish_generator.hpp"
+#include "polish_operators.hpp"
+
+namespace polish {
+
+class CompiledExpression;
+
+// 小数部を一定の桁数(scale)で保持する固定小数点の十進数
+// (金額の計算など、2進数の浮動小数点数による丸め誤差を避けたい場合に用いる)
+class Decimal {
+public:
+    // 小数部の桁数と、それに対応する最小単位の逆数(10^scale)
+    static constexpr int scale = 4;
+    static constexpr std::int64_t unit = 10000;
+
+    constexpr Decimal() noexcept = default;
+
+    // 最小単位(10^-scale)の数unitsで表される値を返すメソッド
+    static constexpr Decimal from_units(std::int64_t units) noexcept
+    {
+        Decimal number;
+
+        number.value = units;
+
+        return number;
+    }
+
+    // 値を最小単位(10^-scale)の数で返すメソッド
+    constexpr std::int64_t units() const noexcept { return value; }
+
+    friend constexpr bool operator==(const Decimal&, const Decimal&) noexcept = default;
+
+private:
+    std::int64_t value = 0;
+};
+
+// 数値型Tを用いて式の値を計算するための特性
+// 特殊化は次のメンバを持つ
+//   value_type        : 数値型T
+//   max_exact_integer : 整数のまま演算しても、数値型Tで演算した場合と同じ結果となる整数の絶対値の最大値
+//                       (0の場合は、整数のまま演算することはしない)
+//   parse             : 文字列を数値化する(変換できない場合はfalseを返す)
+//   format            : 数値を文字列化する(max_exact_integerの範囲内の整数は、整数の表記となる必要がある)
+//   calculate         : 演算子に応じて左右の項を演算する(演算できない場合はfalseを返す)
+template <typename T>
+struct NumericTraits;
+
+// 浮動小数点数の特性(float, double, long doubleで用いる)
+// 数値は、その型の精度で往復変換できる桁数(max_digits10)で文字列化する(doubleの場合は%.17gと同じ)
+template <std::floating_point T>
+struct NumericTraits<T> {
+    using value_type = T;
+
+    static constexpr std::int64_t max_exact_integer = std::int64_t(1) << std::min(std::numeric_limits<T>::digits, 53);
+
+    static bool parse(std::string_view expression, T& number) noexcept;
+    static std::string format(const T& number);
+    static bool calculate(char operator_char, const T& left_operand, const T& right_operand, T& result) noexcept;
+};
+
+// 固定小数点の十進数の特性
+// 小数部がscale桁より長い数値や、演算結果の小数部がscale桁より長くなる場合は、scale桁に四捨五入する
+// 指数表記の数値は数値として扱わず、演算結果が表現できる範囲を超える場合やゼロ除算・ゼロでの剰余の場合は演算できないものとする
+// (累乗の結果は一般に有限の桁数で表せないため、累乗は演算できないものとする)
+template <>
+struct NumericTraits<Decimal> {
+    using value_type = Decimal;
+
+    static constexpr std::int64_t max_exact_integer = 0;
+
+    static bool parse(std::string_view expression, Decimal& number) noexcept;
+    static std::string format(const Decimal& number);
+    static bool calculate(char operator_char, const Decimal& left_operand, const Decimal& right_operand, Decimal& result) noexcept;
+};
+
+// 二分木への分割に失敗した原因
+enum class ParseErrorCode {
+    empty_expression,   // 式が空(空白のみの場合を含む)
+    unbalanced_bracket, // 開き括弧と閉じ括弧が同数でない
+    empty_bracket,      // 空の丸括弧"()"がある
+    invalid_expression, // 演算子の位置が(部分)式の先頭または末尾にある
+};
+
+// 二分木への分割に失敗したことを表すエラー(例外を送出せずにエラーを報告する場合に用いる)
+// エラーメッセージは、message()を呼び出した時点で初めて文字列化する
+struct ParseError {
+    ParseErrorCode code;
+    std::size_t offset = 0;     // 空白を除去した式における、エラーの原因となった部分式の位置(バイト単位)
+    std::size_t length = 0;     // エラーの原因となった部分式の長さ
+    std::string expression;     // 空白を除去した式
+
+    // エラーの原因となった部分式を返すメソッド
+    std::string_view subexpression() const noexcept { return std::string_view(expression).substr(offset, length); }
+
+    // MalformedExpressionExceptionで報告する場合と同じエラーメッセージを返すメソッド
+    std::string message() const;
+};
+
+// ノードを構成するデータ構造
+class Node {
+    friend class ColumnarExpression;
+    friend class CompiledExpression;
+    friend class ExpressionTreeImage;
+    friend class IncrementalParser;
+    friend class ShapeCache;
+    template <typename T> friend struct NumericTraits;
+
+private:
+    std::string expression; // このノードが表す式(二分木への分割後は演算子または項となる)
+    std::unique_ptr<Node> left = nullptr;   // 左の子ノード
+    std::unique_ptr<Node> right = nullptr;  // 右の子ノード
+
+    // 括弧の対応を検証せずにノードを構成するコンストラクタ(分割済みの二分木を複製する場合に用いる)
+    Node() = default;
+
+public:
+    // コンストラクタ(与えられた式expressionを持つノードを構成する)
+    Node(const std::string& expression);
+
+    // 式expressionを二分木へと分割するメソッド
+    // 左右の部分式がどちらもparallel_parse_threshold文字以上の場合は、それらを並列に分割する
+    // (同時に並列に分割するタスクの数はハードウェアのスレッド数までとし、それを超える場合は逐次的に分割する)
+    void parse_expression();
+
+    // 左右の部分式を並列に分割するかどうかを判断するための、部分式の長さのしきい値
+    static constexpr std::string::size_type parallel_parse_threshold = 0x10000;
+
+    // 空白を除去した式expressionを二分木へと分割して根ノードを返すメソッド
+    // parse_expressionと同じ分割を行うが、式が不正な形式の場合は例外を送出せずにエラーを返す
+    static std::expected<std::unique_ptr<Node>, ParseError> try_parse(std::string expression);
+
+    // 二分木を巡回し、ノードの行きがけ・通りがけ・帰りがけに指定された関数をコールバックするメソッド
+    void traverse(
+        std::function<void(Node&)> on_visit,      // ノードの行きがけにコールバックする関数
+        std::function<void(Node&)> on_transit,    // ノードの通りがけにコールバックする関数
+        std::function<void(Node&)> on_leave       // ノードの帰りがけにコールバックする関数
+    );
+
+    // 後行順序訪問(帰りがけ順)で二分木を巡回して
+    // すべてのノードの演算子または項をstreamに出力するメソッド
+    void write_postorder(std::ostream& stream);
+
+    // 中間順序訪問(通りがけ順)で二分木を巡回して
+    // すべてのノードの演算子または項をstreamに出力するメソッド
+    void write_inorder(std::ostream& stream);
+
+    // 先行順序訪問(行きがけ順)で二分木を巡回して
+    // すべてのノードの演算子または項をstreamに出力するメソッド
+    void write_preorder(std::ostream& stream);
+
+    // 先行順序訪問(行きがけ順)・中間順序訪問(通りがけ順)・後行順序訪問(帰りがけ順)で二分木を巡回し、
+    // ノードを1つずつ生成するジェネレータを返すメソッド
+    // 巡回は次のノードを取り出した時点で進めるため、途中で取り出すのをやめた場合、それ以降のノードは巡回しない
+    // (再帰呼び出しを用いず、巡回中のノードをコルーチン内のスタックに保持する)
+    // 取り出し終えるまでの間は、二分木を変更してはならない
+    Generator<const Node> preorder() const;
+    Generator<const Node> inorder() const;
+    Generator<const Node> postorder() const;
+
+    // このノードが表す演算子または項を返すメソッド
+    std::string_view token() const noexcept { return expression; }
+
+    // 後行順序訪問(帰りがけ順)で二分木を巡回して、二分木全体の値を計算するメソッド
+    // すべてのノードの値が計算できた場合はtrue、そうでない場合(記号を含む場合など)はfalseを返す
+    // 計算結果はresult_valueに代入する
+    bool calculate_expression_tree(double& result_value);
+
+    // calculate_expression_tree(double&)と同様に、数値型T(NumericTraits<T>)を用いて二分木全体の値を計算するメソッド
+    // (float, double, long double, Decimalに対して提供する)
+    template <typename T>
+    bool calculate_expression_tree(T& result_value);
+
+    // 演算結果の数値を文字列化するためのメソッド
+    static std::string format_number(const double& number) noexcept;
+
+private:
+    // 二分木への分割に失敗した原因と、その原因となった部分式
+    // (部分式は分割元の式を参照し、エラーを報告する時点でParseErrorの位置に変換する)
+    struct ParseFailure {
+        ParseErrorCode code;
+        std::string_view subexpression;
+    };
+
+    // 式expression内の括弧の対応を検証するメソッド
+    // 開き括弧と閉じ括弧が同数でない場合はエラーとする
+    static void validate_bracket_balance(const std::string_view& expression);
+
+    // 式expression内の括弧の対応を検証し、開き括弧と閉じ括弧が同数であればtrueを返すメソッド
+    static bool is_bracket_balanced(const std::string_view& expression) noexcept;
+
+    // 式expressionから最も外側にある丸括弧を取り除くメソッド
+    // 空の丸括弧"()"がある場合は、expressionをその部分とした上でfalseを返す
+    static bool remove_outermost_bracket(std::string_view& expression) noexcept;
+
+    // 括弧の対応を検証済みの式expressionから最も外側にある丸括弧を取り除き、分割する演算子の位置をpos_operatorに代入するメソッド
+    // 項の場合はpos_operatorにstring::nposを代入してtrueを返し、式が不正な形式の場合はfailureに原因を代入してfalseを返す
+    // (parse_subexpressionとIncrementalParserとで、同じ方法で部分式を分割するために用いる)
+    static bool split_subexpression(std::string_view& expression, std::string::size_type& pos_operator, ParseFailure& failure) noexcept;
+
+    // 括弧の対応を検証済みの式expressionを、このノードを根とする二分木へと分割するメソッド
+    // 式が不正な形式の場合は、例外を送出せずにfailureに原因を代入してfalseを返す
+    // (ノードは分割元の式を参照せず、項と演算子のみを複製して保持する)
+    bool parse_subexpression(std::string_view expression, ParseFailure& failure);
+
+    // 分割元の式sourceに対するfailureを、ParseErrorに変換するメソッド
+    static ParseError make_parse_error(std::string&& source, const ParseFailure& failure);
+
+    // 式expressionから最も優先順位が低い演算子を探して位置を返す関数
+    // (同じ優先順位の演算子が複数ある場合、左結合の演算子は最も右側、右結合の演算子は最も左側のものとする)
+    // (演算子がない場合はstring::nposを返す)
+    static std::string::size_type get_operator_position(const std::string_view& expression) noexcept;
+
+    // 与えられたノードの演算子と左右の子ノードの値から、数値型Tを用いてノードの値を計算する関数
+    // 計算できた場合、計算結果の値はnode.expressionに文字列として代入し、左右のノードは削除する
+    template <typename T>
+    static void calculate_node(Node& node);
+
+    // 与えられた文字列を数値化するメソッド
+    // 正常に変換できた場合はnumberに変換した数値を代入し、trueを返す
+    // 変換できなかった場合はfalseを返す
+    static bool parse_number(const std::string_view& expression, double& number) noexcept;
+
+    // doubleで正確に表すことができる整数の絶対値の最大値(2^53)
+    // 演算結果がこの範囲内の整数となる場合は、整数のまま演算してもdoubleで演算した場合と同じ結果となる
+    static constexpr std::int64_t max_exact_integer = NumericTraits<double>::max_exact_integer;
+
+    // 与えられた文字列を、limitの範囲内の整数として数値化するメソッド
+    // 整数の形式(符号と数字のみ)でない場合や、範囲外の場合、負のゼロ("-0")の場合はfalseを返す
+    static bool parse_integer(const std::string_view& expression, std::int64_t limit, std::int64_t& number) noexcept;
+
+    // limitの範囲内の整数の左項left_operandと右項right_operandを、演算子operator_charで演算するメソッド
+    // 浮動小数点数で演算した場合と同じ結果が得られる場合のみ、結果をresultに代入してtrueを返す
+    // (結果がlimitの範囲外となる場合、除算が割り切れない場合、結果が負のゼロとなる場合、累乗の場合はfalseを返す)
+    static bool calculate_integer(char operator_char, std::int64_t left_operand, std::int64_t right_operand, std::int64_t limit, std::int64_t& result) noexcept;
+
+    // 整数を文字列化するメソッド(max_exact_integerの範囲内の値に対しては、format_numberと同じ結果となる)
+    static std::string format_integer(std::int64_t number);
+};
+
+// 提供する数値型に対するcalculate_expression_treeの実体(libpolishに含まれる)
+extern template bool Node::calculate_expression_tree<float>(float& result_value);
+extern template bool Node::calculate_expression_tree<double>(double& result_value);
+extern template bool Node::calculate_expression_tree<long double>(long double& result_value);
+extern template bool Node::calculate_expression_tree<Decimal>(Decimal& result_value);
+
+// 与えられた式が不正な形式であることを報告するための例外クラス
+class MalformedExpressionException : public std::exception {
+public:
+    MalformedExpressionException(const std::string& message)
+        : message(message)
+    {
+    }
+
+    virtual const char* what() const noexcept override { return message.c_str(); }
+
+protected:
+    std::string message;
+};
+
+// 数値のリテラルのみが異なる式(同じ形状の式)に対して、二分木への分割結果を再利用するためのキャッシュ
+// 式中の数値のリテラルをプレースホルダ(placeholder)に置き換えたものを式の形状とし、
+// 形状ごとに、分割済みの二分木の項をプレースホルダに置き換えたもの(二分木のひな形)を保持する
+// 例:"(2*3)/(1-0.5)"と"(10*4)/(1-0.25)"は、いずれも形状"(#*#)/(#-#)"となる
+//
+// 二分木の形は演算子と丸括弧の位置のみで決まるため、同じ形状の式はひな形と同じ形の二分木へと分割される
+// そのため、キャッシュにある形状の式は、ひな形を複製してリテラルの値を当てはめるだけで二分木とすることができる
+// (括弧の対応の検証・最も外側の括弧の除去・演算子の探索は行わない)
+//
+// compile_thresholdを指定した場合は、値をその回数を超えて計算しようとした形状のひな形を機械語に変換し(CompiledExpression)、
+// 以降はその形状の式の値を二分木を用いずに計算する(変換できない形状や環境では、引き続き二分木で計算する)
+//
+// 複数のスレッドから同時に使用することができる
+class ShapeCache {
+public:
+    // 式の形状において、数値のリテラルを置き換えるプレースホルダ
+    // (この文字を含む式は、形状を一意に定められないためキャッシュの対象外とする)
+    static constexpr char placeholder = '#';
+
+    // 保持する形状の数の既定値
+    static constexpr std::size_t default_capacity = 1024;
+
+    // コンストラクタ(保持する形状の数をcapacity、機械語に変換するまでに計算する回数をcompile_thresholdとする)
+    // 保持する形状の数がcapacityに達した場合は、新たな形状を追加する際に最も古く追加された形状を破棄する(FIFO)
+    // compile_thresholdが0の場合は、機械語への変換を行わない
+    explicit ShapeCache(std::size_t capacity = default_capacity, std::uint64_t compile_threshold = 0);
+
+    ShapeCache(const ShapeCache&) = delete;
+    ShapeCache& operator=(const ShapeCache&) = delete;
+
+    // 空白を除去した式expressionと同じ形状の二分木がある場合は、それにリテラルの値を当てはめた二分木を返すメソッド
+    // (ない場合はnullptrを返す)
+    // result_valueがnullptrでない場合は、式の値を計算しようとした回数として計上し、
+    // 形状が機械語に変換済みであれば式全体の値を計算してresult_valueに代入する
+    // (代入しなかった場合は、返した二分木で計算する必要がある)
+    std::unique_ptr<Node> find(const std::string& expression, std::optional<double>* result_value = nullptr);
+
+    // 空白を除去した式expressionを分割した二分木rootを、その式の形状の二分木として追加するメソッド
+    // (二分木は値を計算する前のものを与える必要がある)
+    // 同じ形状が既にある場合(他のスレッドが先に追加した場合など)は、既にある形状を保持して何もしない
+    void add(const std::string& expression, const Node& root);
+
+    // 空白を除去した式expressionを二分木へと分割して根ノードを返すメソッド
+    // 同じ形状の二分木がある場合はそれを用い、ない場合は分割した二分木を追加する
+    // 式が不正な形式の場合はMalformedExpressionExceptionを送出する
+    std::unique_ptr<Node> parse(const std::string& expression);
+
+    // 同じ形状の二分木があった回数・なかった回数を返すメソッド
+    std::uint64_t hits() const noexcept { return hit_count.load(std::memory_order_relaxed); }
+    std::uint64_t misses() const noexcept { return miss_count.load(std::memory_order_relaxed); }
+
+    // 機械語に変換した形状の数と、変換した機械語で式の値を計算した回数を返すメソッド
+    std::uint64_t compilations() const noexcept { return compilation_count.load(std::memory_order_relaxed); }
+    std::uint64_t compiled_evaluations() const noexcept { return compiled_evaluation_count.load(std::memory_order_relaxed); }
+
+private:
+    // 形状ごとに保持する情報
+    struct Shape {
+        std::unique_ptr<const Node> tree;                   // 二分木のひな形
+        std::atomic<std::uint64_t> evaluations = 0;         // 値を計算しようとした回数
+        std::shared_ptr<const CompiledExpression> compiled; // 機械語に変換したひな形(変換できなかった場合はnullptr)
+        std::atomic<bool> compiled_ready = false;           // 機械語への変換を終えて、compiledを設定したかどうか
+    };
+
+    std::size_t capacity;
+    std::uint64_t compile_threshold;
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<Shape>> shapes; // 形状と、その形状の情報
+    std::deque<std::string> insertion_order;                        // 形状を追加した順序(古いものから順に破棄する)
+    std::atomic<std::uint64_t> hit_count = 0;
+    std::atomic<std::uint64_t> miss_count = 0;
+    std::atomic<std::uint64_t> compilation_count = 0;
+    std::atomic<std::uint64_t> compiled_evaluation_count = 0;
+
+    // 式expressionの形状をshapeに代入するメソッド
+    // literalsがnullptrでない場合は、プレースホルダに置き換えたリテラルを出現順に追加する
+    // 式がプレースホルダの文字を含む場合はfalseを返す
+    static bool canonicalize(std::string_view expression, std::string& shape, std::vector<std::string_view>* literals);
+
+    // 分割済みの二分木nodeの項をプレースホルダに置き換えて、二分木のひな形を作成するメソッド
+    static std::unique_ptr<Node> make_template(const Node& node);
+
+    // 二分木のひな形nodeを複製し、プレースホルダにリテラルnext以降を順に当てはめるメソッド
+    static std::unique_ptr<Node> instantiate(const Node& node, std::vector<std::string_view>::const_iterator& next);
+
+    // 形状shapeの値を計算しようとした回数を計上し、機械語に変換済みであればリテラルliteralsを当てはめた値を計算するメソッド
+    // (計算回数がcompile_thresholdを超えた時点で、機械語に変換する)
+    std::optional<double> evaluate(Shape& shape, const std::vector<std::string_view>& literals);
+};
+
+// 式expressionから空白を除去し、二分木へと分割して根ノードを返す関数
+// 式が空の場合や不正な形式の場合はMalformedExpressionExceptionを送出する
+std::unique_ptr<Node> parse(std::string_view expression);
+
+// parseと同様に式expressionを二分木へと分割する関数
+// 式が空の場合や不正な形式の場合は、例外を送出せずにエラー(ParseError)を返す
+// (不正な式が多く含まれる入力を扱う場合など、例外の送出によるコストを避けたい場合に用いる)
+std::expected<std::unique_ptr<Node>, ParseError> try_parse(std::string_view expression);
+
+// 式inputを二分木へと分割・計算し、実行可能ファイルpolishと同じ形式で結果をoutputに出力する関数
+// 式が不正な形式の場合は、エラーメッセージをerrorに出力する
+// 二分木へと分割した後、値を計算する前に、根ノードと空白を除去した式を引数としてon_parsedを呼び出す
+// (on_parsedがfalseを返した場合は、その時点で処理を中止する)
+// shape_cacheを指定した場合は、そのキャッシュを用いて二分木へと分割する
+// 戻り値はpolishの終了コードと同じで、次の値を返す
+//   0: 二分木への分割、および式全体の値の計算に成功した場合
+//   1: 二分木への分割に失敗した場合(式が空の場合、またはon_parsedがfalseを返した場合を含む)
+//   2: 式全体の値の計算に失敗した場合
+int process_expression(
+    std::string_view input,
+    std::ostream& output,
+    std::ostream& error,
+    const std::function<bool(Node&, const std::string&)>& on_parsed = nullptr,
+    ShapeCache* shape_cache = nullptr
+);
+
+// 二分木を、ファイルに保存してそのまま読み込めるバイナリ形式(ツリーイメージ)で扱うクラス
+// ツリーイメージは以下の各部分をこの順に並べたもので、数値は実行環境のバイト順で格納する
+//   ヘッダ      : 識別子・形式のバージョン・各部分の要素数・チェックサム
+//   リテラル表  : 数値として扱える項の値と、その項の文字列の位置
+//   ノード配列  : 後行順序(帰りがけ順)に並べたノード(最後の要素が根ノードとなる)
+//   シンボル表  : 数値として扱えない項(記号など)の文字列の位置
+//   文字列表    : 元の式と、各項の文字列
+// 読み込んだツリーイメージは、ノードごとの確保や変換を行わずに、与えられた領域を直接参照して使用する
+// (そのため、mmapした領域をそのまま使用することができる)
+class ExpressionTreeImage {
+public:
+    // ツリーイメージの形式のバージョン
+    static constexpr std::uint32_t format_version = 1;
+
+    // 分割済みの二分木rootをツリーイメージとしてstreamに書き込むメソッド
+    // (二分木は値を計算する前のものを与える必要がある)
+    static void save(Node& root, const std::string_view& expression, std::ostream& stream);
+
+    // 領域[data, data + length)にあるツリーイメージを検証し、その領域を参照するインスタンスを返すメソッド
+    // (領域は、返されたインスタンスを使用している間は解放してはならない)
+    static ExpressionTreeImage load(const void* data, std::size_t length);
+
+    // 二分木へと分割する前の元の式を返すメソッド
+    std::string_view expression() const noexcept;
+
+    // Node::write_postorderと同様に、後行順序訪問(帰りがけ順)ですべてのノードの演算子または項をstreamに出力するメソッド
+    void write_postorder(std::ostream& stream) const;
+
+    // Node::write_inorderと同様に、中間順序訪問(通りがけ順)ですべてのノードの演算子または項をstreamに出力するメソッド
+    void write_inorder(std::ostream& stream) const;
+
+    // Node::write_preorderと同様に、先行順序訪問(行きがけ順)ですべてのノードの演算子または項をstreamに出力するメソッド
+    void write_preorder(std::ostream& stream) const;
+
+    // Node::calculate_expression_treeと同様に、二分木全体の値を計算するメソッド
+    // すべてのノードの値が計算できた場合はtrue、そうでない場合はfalseを返す
+    // (ツリーイメージの領域は変更せず、計算結果はresult_valueにのみ代入する)
+    bool calculate_expression_tree(double& result_value) const;
+
+    // 値を計算できた部分式をその値に置き換えて、計算結果の式を中置記法でstreamに出力するメソッド
+    // (Node::calculate_expression_treeで計算した後にNode::write_inorderで出力した場合と同じ結果となる)
+    void write_calculated_inorder(std::ostream& stream) const;
+
+private:
+    // 文字列表中の文字列の位置
+    struct StringReference {
+        std::uint32_t offset;   // 文字列表の先頭からの位置
+        std::uint32_t length;   // 文字列の長さ
+    };
+
+    // ヘッダ
+    struct Header {
+        char magic[4];                      // 識別子("PNTI")
+        std::uint32_t version;              // 形式のバージョン
+        std::uint32_t node_count;           // ノード配列の要素数
+        std::uint32_t literal_count;        // リテラル表の要素数
+        std::uint32_t symbol_count;         // シンボル表の要素数
+        std::uint32_t string_table_length;  // 文字列表の長さ
+        StringReference expression;         // 元の式
+        std::uint32_t checksum;             // ヘッダ以降の全体のチェックサム(FNV-1a, 32ビット)
+        std::uint32_t reserved;
+    };
+
+    // リテラル表の要素
+    struct Literal {
+        double value;           // 項を数値化した値
+        StringReference text;   // 項の文字列
+    };
+
+    // ノードの種類
+    enum class NodeKind : std::uint8_t {
+        operator_node,  // 演算子(左右に子ノードを持つ)
+        literal,        // 数値として扱える項
+        symbol,         // 数値として扱えない項
+    };
+
+    // ノード配列の要素
+    struct NodeEntry {
+        NodeKind kind;              // ノードの種類
+        char operator_char;         // 演算子(kindがoperator_nodeの場合のみ)
+        std::uint16_t reserved;
+        std::uint32_t left;         // 左の子ノードのインデックス(kindがoperator_nodeの場合のみ)
+        std::uint32_t right;        // 右の子ノードのインデックス(kindがoperator_nodeの場合のみ)
+        std::uint32_t table_index;  // リテラル表またはシンボル表のインデックス(kindがliteralまたはsymbolの場合のみ)
+    };
+
+    static constexpr char magic[4] = { 'P', 'N', 'T', 'I' };
+
+    const Header* header;
+    const Literal* literals;
+    const NodeEntry* nodes;
+    const StringReference* symbols;
+    const char* strings;
+
+    ExpressionTreeImage(const char* data) noexcept;
+
+    // ツリーイメージのチェックサムを計算するメソッド
+    static std::uint32_t calculate_checksum(const char* data, std::size_t length) noexcept;
+
+    // インデックスindexのノードを根とする部分木を巡回し、
+    // ノードの行きがけ・通りがけ・帰りがけに指定された関数をコールバックするメソッド
+    void traverse(
+        std::uint32_t index,
+        const std::function<void(const NodeEntry&)>& on_visit,
+        const std::function<void(const NodeEntry&)>& on_transit,
+        const std::function<void(const NodeEntry&)>& on_leave
+    ) const;
+
+    // 根ノードのインデックスを返すメソッド
+    std::uint32_t root_index() const noexcept { return header->node_count - 1; }
+
+    // ノードが表す演算子または項を返すメソッド
+    std::string_view text_of(const NodeEntry& node) const noexcept;
+
+    // すべてのノードについて、計算できた場合はその値を返すメソッド
+    std::vector<std::optional<double>> calculate_nodes() const;
+};
+
+// 与えられたツリーイメージが不正な形式であることを報告するための例外クラス
+class MalformedTreeImageException : public std::exception {
+public:
+    MalformedTreeImageException(const std::string& message)
+        : message(message)
+    {
+    }
+
+    virtual const char* what() const noexcept override { return message.c_str(); }
+
+protected:
+    std::string message;
+};
+
+// ファイルを読み取り専用でメモリにマップするクラス
+class MappedFile {
+public:
+    // パスpathのファイルをマップする(ファイルを開けない場合は例外を送出する)
+    MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // マップした領域の先頭を返すメソッド
+    const void* data() const noexcept;
+
+    // マップした領域の長さを返すメソッド
+    std::size_t size() const noexcept;
+
+private:
+#if defined(_WIN32)
+    std::vector<char> buffer; // mmapを使用できない環境では、ファイル全体を読み込んで保持する
+#else
+    void* address = nullptr;  // マップした領域の先頭
+    std::size_t length = 0;   // マップした領域の長さ
+#endif
+};
+
+} // namespace polish
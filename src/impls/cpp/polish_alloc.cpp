@@ -0,0 +1,71 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// メモリの確保を処理ごと・式ごとに記録するため、グローバルなoperator new/deleteを置き換える
+// マクロPOLISH_ALLOC_STATSを定義した場合のみ置き換える(定義しない場合は何も定義しない)
+//
+// 解放時に確保中のメモリの量を求めるため、確保した領域の先頭に要求された大きさを格納しておく
+// (アラインメントを指定したoperator new/deleteは置き換えず、記録の対象外とする)
+#if defined(POLISH_ALLOC_STATS)
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "polish_stats.hpp"
+
+using namespace polish;
+
+namespace {
+
+// 領域の先頭に格納する大きさのために確保する長さ
+// (返す領域のアラインメントを保つため、既定のアラインメントの大きさとする)
+constexpr std::size_t header_length = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+void* allocate(std::size_t size) noexcept
+{
+    auto p = static_cast<char*>(std::malloc(header_length + size));
+
+    if (!p)
+        return nullptr;
+
+    *reinterpret_cast<std::size_t*>(p) = size;
+
+    Statistics::record_allocation(size);
+
+    return p + header_length;
+}
+
+void deallocate(void* p) noexcept
+{
+    if (!p)
+        return;
+
+    auto header = static_cast<char*>(p) - header_length;
+
+    Statistics::record_deallocation(*reinterpret_cast<std::size_t*>(header));
+
+    std::free(header);
+}
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    if (auto p = allocate(size))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void operator delete(void* p) noexcept { deallocate(p); }
+void operator delete[](void* p) noexcept { deallocate(p); }
+void operator delete(void* p, std::size_t) noexcept { deallocate(p); }
+void operator delete[](void* p, std::size_t) noexcept { deallocate(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { deallocate(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { deallocate(p); }
+
+#endif // defined(POLISH_ALLOC_STATS)
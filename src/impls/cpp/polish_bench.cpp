@@ -0,0 +1,593 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// 合成した式のコーパスを用いて、各処理の性能を計測するベンチマーク
+//
+// 使用方法:
+//   polish-bench [--csv <file>] [--json <file>] [--seed <n>] [--min-time <ms>] [--corpus <name>]...
+//     --csv/--json: 計測結果をCSV/JSON形式でファイルに出力する(いずれも省略した場合はCSV形式で標準出力に出力する)
+//     --seed: コーパスを生成する乱数のシード(同じシードからは常に同じコーパスが生成される)
+//     --min-time: 各処理を計測する最小の時間
+//     --corpus: 計測するコーパス(省略した場合はすべてのコーパスを計測する)
+//   polish-bench --generate <name> [--seed <n>]
+//     コーパスを生成し、1行に1つの式として標準出力に出力する
+//   polish-bench --list
+//     コーパスの一覧を出力する
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "polish.hpp"
+#include "polish_incremental.hpp"
+#include "polish_stats.hpp"
+
+using namespace polish;
+
+// それまでに確保されたメモリの量と回数
+// (polish-benchはpolish_alloc.cppを常にPOLISH_ALLOC_STATSを定義してリンクし、
+// 置き換えたoperator new/deleteがStatisticsに記録した確保を、すべての処理の区分について合計して求める)
+struct AllocationTotals {
+    std::uint64_t bytes = 0;
+    std::uint64_t count = 0;
+};
+
+AllocationTotals allocation_totals()
+{
+    auto snapshot = Statistics::snapshot();
+    AllocationTotals totals;
+
+    for (std::size_t i = 0; i <= phase_count; i++) {
+        totals.bytes += snapshot.phase_allocated_bytes[i];
+        totals.count += snapshot.phase_allocations[i];
+    }
+
+    return totals;
+}
+
+// 再現可能な乱数列を生成するクラス(SplitMix64)
+// (標準ライブラリの分布クラスは実装によって結果が異なるため、分布も含めて独自に実装する)
+class Random {
+public:
+    Random(std::uint64_t seed) : state(seed) {}
+
+    std::uint64_t next()
+    {
+        auto z = (state += 0x9E3779B97F4A7C15ull);
+
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+
+        return z ^ (z >> 31);
+    }
+
+    // [0, bound)の範囲の整数を返すメソッド
+    std::uint64_t uniform(std::uint64_t bound) { return next() % bound; }
+
+    // 確率probabilityでtrueを返すメソッド
+    bool chance(double probability) { return static_cast<double>(next() >> 11) * 0x1.0p-53 < probability; }
+
+private:
+    std::uint64_t state;
+};
+
+// 二分木の形状
+enum class ChainShape {
+    balanced,   // 左右の部分木の演算子の数が均等になる
+    left,       // 左の部分木のみが伸びる("1+2+3+4"など)
+    right,      // 右の部分木のみが伸びる("1+(2+(3+4))"など)
+    random,     // 左右の部分木の演算子の数を無作為に決める
+};
+
+// コーパスの生成条件
+struct CorpusShape {
+    std::string_view name;
+    std::size_t count;          // 生成する式の数
+    std::size_t operators;      // 1つの式に含まれる演算子の数
+    ChainShape chain;           // 二分木の形状
+    double bracket_ratio;       // 部分式を余分な丸括弧でくくる割合(くくった場合はさらに同じ割合で重ねてくくる)
+    double symbol_ratio;        // 項を記号とする割合(それ以外の項は数値とする)
+    std::string_view operator_mix; // 使用する演算子(同じ演算子を複数含めると、その演算子が選ばれる割合が高くなる)
+};
+
+constexpr CorpusShape corpus_shapes[] = {
+    // name                 count  operators  chain                 bracket  symbol  operator_mix
+    { "short-arithmetic",   10000,         4, ChainShape::random,      0.1,    0.0,  "+-*/" },
+    { "medium-balanced",     2000,        64, ChainShape::balanced,    0.1,    0.0,  "+-*/" },
+    { "left-chain",           500,       512, ChainShape::left,        0.0,    0.0,  "+-" },
+    { "right-chain",          500,       512, ChainShape::right,       0.0,    0.0,  "+-" },
+    { "deep-brackets",       1000,        32, ChainShape::random,      0.7,    0.0,  "+-*/" },
+    { "symbol-heavy",        2000,        64, ChainShape::random,      0.1,    0.8,  "+-*/" },
+    { "assignments",         2000,        16, ChainShape::random,      0.1,    0.3,  "=+-*/" },
+    { "mul-div-only",        2000,        64, ChainShape::random,      0.0,    0.0,  "*/" },
+    { "power-modulo",        2000,        16, ChainShape::random,      0.1,    0.0,  "+-*/%^" },
+    { "huge-balanced",          4,     65536, ChainShape::balanced,    0.05,   0.1,  "+-*/" },
+    // C言語での実装(../c/polish.c)で扱える長さ(255文字・80ノード)以内に収まる式
+    { "c-sized",             2000,        24, ChainShape::random,      0.1,    0.2,  "+-*/" },
+};
+
+// 条件shapeに従って式を生成するクラス
+class ExpressionGenerator {
+public:
+    ExpressionGenerator(const CorpusShape& shape, Random& random) : shape(shape), random(random) {}
+
+    std::string generate()
+    {
+        std::string expression;
+
+        write_subexpression(shape.operators, expression);
+
+        return expression;
+    }
+
+private:
+    const CorpusShape& shape;
+    Random& random;
+
+    // operators個の演算子を含む部分式をexpressionに追記し、その部分式の最上位の演算子を返す(項の場合は'\0'を返す)
+    char write_subexpression(std::size_t operators, std::string& expression)
+    {
+        if (0 == operators) {
+            write_term(expression);
+            return '\0';
+        }
+
+        std::size_t left_operators;
+
+        switch (shape.chain) {
+            case ChainShape::balanced: left_operators = (operators - 1) / 2; break;
+            case ChainShape::left: left_operators = operators - 1; break;
+            case ChainShape::right: left_operators = 0; break;
+            default: left_operators = random.uniform(operators); break;
+        }
+
+        auto op = shape.operator_mix[random.uniform(shape.operator_mix.length())];
+
+        // 生成した二分木の形状が保たれるよう、必要な場合は左右の部分式を丸括弧でくくる
+        // (優先順位が低い場合と、優先順位が同じで演算子の結合性と反対側の部分式である場合にくくる必要がある)
+        write_operand(left_operators, op, false, expression);
+        expression += op;
+        write_operand(operators - 1 - left_operators, op, true, expression);
+
+        return op;
+    }
+
+    void write_operand(std::size_t operators, char parent_op, bool is_right, std::string& expression)
+    {
+        auto extra_brackets = 0;
+
+        while (random.chance(shape.bracket_ratio) && extra_brackets < 8) {
+            extra_brackets++;
+        }
+
+        auto start = expression.length();
+        auto op = write_subexpression(operators, expression);
+        auto precedence = Operators::precedence_of(op);
+        auto parent_precedence = Operators::precedence_of(parent_op);
+        auto needs_bracket = '\0' != op && (
+            precedence < parent_precedence ||
+            (precedence == parent_precedence && is_right != (Associativity::right == Operators::associativity_of(parent_op)))
+        );
+        auto brackets = extra_brackets + (needs_bracket ? 1 : 0);
+
+        expression.insert(start, brackets, '(');
+        expression.append(brackets, ')');
+    }
+
+    void write_term(std::string& expression)
+    {
+        if (random.chance(shape.symbol_ratio)) {
+            // 記号("x", "y3"など)
+            expression += static_cast<char>('a' + random.uniform(26));
+
+            if (random.chance(0.3))
+                expression += std::to_string(random.uniform(100));
+
+            return;
+        }
+
+        // 数値(整数、小数、指数表記)
+        switch (random.uniform(4)) {
+            case 0: expression += std::to_string(random.uniform(10)); break;
+            case 1: expression += std::to_string(random.uniform(100000)); break;
+            case 2: expression += std::to_string(random.uniform(1000)) + "." + std::to_string(random.uniform(1000)); break;
+            default: expression += std::to_string(1 + random.uniform(9)) + "e" + std::to_string(random.uniform(20)); break;
+        }
+    }
+};
+
+// コーパスを生成する関数
+std::vector<std::string> generate_corpus(const CorpusShape& shape, std::uint64_t seed)
+{
+    // コーパスごとに異なる乱数列となるよう、コーパスの名前をシードに混ぜる
+    for (auto ch : shape.name) {
+        seed = seed * 31 + static_cast<unsigned char>(ch);
+    }
+
+    Random random(seed);
+    ExpressionGenerator generator(shape, random);
+    std::vector<std::string> corpus;
+
+    for (std::size_t i = 0; i < shape.count; i++) {
+        corpus.push_back(generator.generate());
+    }
+
+    return corpus;
+}
+
+// 出力された文字数だけを数え、内容を破棄するストリームバッファ
+class CountingStreamBuffer : public std::streambuf {
+public:
+    std::uint64_t count = 0;
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        count++;
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char_type*, std::streamsize length) override
+    {
+        count += length;
+        return length;
+    }
+};
+
+// 1つの処理の計測結果
+struct BenchmarkResult {
+    std::string_view corpus;
+    std::string_view phase;
+    std::size_t expressions;        // コーパスに含まれる式の数
+    std::uint64_t corpus_bytes;     // コーパスに含まれる式の長さの合計
+    std::uint64_t passes;           // コーパス全体に対して処理を繰り返した回数
+    double ns_per_op;               // 式1つあたりの処理時間(ナノ秒)
+    double bytes_allocated_per_op;  // 式1つあたりに確保されたメモリの量
+    double allocations_per_op;      // 式1つあたりにメモリを確保した回数
+    double ops_per_second;          // 1秒あたりに処理できる式の数
+    double megabytes_per_second;    // 1秒あたりに処理できる式の長さ(MB)
+};
+
+// 計測の設定
+struct BenchmarkOptions {
+    std::uint64_t seed = 1;
+    std::chrono::nanoseconds min_time = std::chrono::milliseconds(200);
+};
+
+// コーパス全体に対する処理を、合計の計測時間がmin_timeに達するまで繰り返して計測するクラス
+// 各回の処理の前にprepareを呼び出し(計測に含めない)、その後に計測対象のrunを呼び出す
+class PhaseBenchmark {
+public:
+    PhaseBenchmark(const BenchmarkOptions& options, std::string_view corpus_name, const std::vector<std::string>& corpus)
+        : options(options), corpus_name(corpus_name), corpus(corpus)
+    {
+        for (auto& expression : corpus) {
+            corpus_bytes += expression.length();
+        }
+    }
+
+    BenchmarkResult measure(
+        std::string_view phase,
+        const std::function<void()>& prepare,
+        const std::function<void()>& run,
+        const std::function<void()>& cleanup = nullptr
+    ) const
+    {
+        std::chrono::nanoseconds elapsed { 0 };
+        std::uint64_t passes = 0, bytes = 0, allocations = 0;
+
+        while (elapsed < options.min_time || 0 == passes) {
+            if (prepare)
+                prepare();
+
+            auto allocated_before = allocation_totals();
+            auto started_at = std::chrono::steady_clock::now();
+
+            run();
+
+            elapsed += std::chrono::steady_clock::now() - started_at;
+
+            auto allocated_after = allocation_totals();
+
+            bytes += allocated_after.bytes - allocated_before.bytes;
+            allocations += allocated_after.count - allocated_before.count;
+            passes++;
+
+            if (cleanup)
+                cleanup();
+        }
+
+        auto ops = static_cast<double>(passes * corpus.size());
+        auto seconds = std::chrono::duration<double>(elapsed).count();
+
+        return BenchmarkResult {
+            corpus_name,
+            phase,
+            corpus.size(),
+            corpus_bytes,
+            passes,
+            seconds * 1e9 / ops,
+            bytes / ops,
+            allocations / ops,
+            ops / seconds,
+            passes * corpus_bytes / seconds / 1e6,
+        };
+    }
+
+private:
+    const BenchmarkOptions& options;
+    std::string_view corpus_name;
+    const std::vector<std::string>& corpus;
+    std::uint64_t corpus_bytes = 0;
+};
+
+// コーパスに対して、各処理(分割・各記法への変換・計算・全体)を計測する関数
+void run_benchmarks(const BenchmarkOptions& options, const CorpusShape& shape, std::vector<BenchmarkResult>& results)
+{
+    auto corpus = generate_corpus(shape, options.seed);
+    auto benchmark = PhaseBenchmark(options, shape.name, corpus);
+    std::vector<std::unique_ptr<Node>> trees;
+    CountingStreamBuffer buffer;
+    std::ostream output(&buffer);
+
+    // コーパスのすべての式を二分木へと分割する
+    auto parse_all = [&]() {
+        for (auto& expression : corpus) {
+            auto root = std::make_unique<Node>(expression);
+
+            root->parse_expression();
+            trees.push_back(std::move(root));
+        }
+    };
+    auto prepare_trees = [&]() { trees.reserve(corpus.size()); };
+    auto parse_trees = [&]() { prepare_trees(); parse_all(); };
+    auto clear_trees = [&]() { trees.clear(); };
+
+    results.push_back(benchmark.measure("parse", prepare_trees, parse_all, clear_trees));
+
+    // 形状キャッシュを用いた分割は、コーパスのすべての形状を追加済みのキャッシュに対して計測する
+    // (すべての式で同じ形状の二分木が見つかる場合の処理時間となる)
+    ShapeCache shape_cache(corpus.size());
+
+    for (auto& expression : corpus) {
+        shape_cache.parse(expression);
+    }
+
+    results.push_back(benchmark.measure("parse_shape_cache", prepare_trees, [&]() {
+        for (auto& expression : corpus) {
+            trees.push_back(shape_cache.parse(expression));
+        }
+    }, clear_trees));
+
+    // 差分のみの分割は、式ごとに末尾への1文字の追加と削除を交互に行い、そのたびに分割し直す処理を計測する
+    // (編集中の式の末尾に入力していく場合に相当する、parseと比較する)
+    std::vector<IncrementalParser> parsers;
+    auto appended = false;
+
+    parsers.reserve(corpus.size());
+
+    for (auto& expression : corpus) {
+        parsers.emplace_back(expression);
+    }
+
+    results.push_back(benchmark.measure("reparse_incremental", nullptr, [&]() {
+        for (auto& parser : parsers) {
+            if (appended)
+                parser.edit(parser.expression().length() - 1, 1, "");
+            else
+                parser.edit(parser.expression().length(), 0, "0");
+        }
+
+        appended = !appended;
+    }));
+
+    parsers.clear();
+
+    // 各記法への変換は、分割済みの同じ二分木に対して繰り返し計測する
+    parse_trees();
+
+    results.push_back(benchmark.measure("write_postorder", nullptr, [&]() {
+        for (auto& root : trees) {
+            root->write_postorder(output);
+        }
+    }));
+    results.push_back(benchmark.measure("write_inorder", nullptr, [&]() {
+        for (auto& root : trees) {
+            root->write_inorder(output);
+        }
+    }));
+    results.push_back(benchmark.measure("write_preorder", nullptr, [&]() {
+        for (auto& root : trees) {
+            root->write_preorder(output);
+        }
+    }));
+
+    // ジェネレータで取り出したノードを出力する場合の、write_postorderと比較するための計測
+    results.push_back(benchmark.measure("postorder_generator", nullptr, [&]() {
+        for (auto& root : trees) {
+            for (auto& node : root->postorder()) {
+                output << node.token() << ' ';
+            }
+        }
+    }));
+
+    clear_trees();
+
+    // 計算は二分木を変更するため、毎回分割し直した二分木に対して計測する
+    // (計算に用いる数値型ごとに計測する、数値型はresult_valueの型で指定する)
+    auto measure_calculate = [&](std::string_view phase, auto result_value) {
+        results.push_back(benchmark.measure(phase, parse_trees, [&]() {
+            for (auto& root : trees) {
+                root->calculate_expression_tree(result_value);
+            }
+        }, clear_trees));
+    };
+
+    measure_calculate("calculate", double());
+    measure_calculate("calculate_float", float());
+    measure_calculate("calculate_long_double", static_cast<long double>(0));
+    measure_calculate("calculate_decimal", Decimal());
+
+    // 機械語に変換した形状での計算は、コーパスのすべての形状を変換済みの形状キャッシュに対して、分割と計算を合わせて計測する
+    // (parse_shape_cacheとcalculateの合計と比較する、機械語で計算できない式は二分木で計算する)
+    ShapeCache compiled_cache(corpus.size(), 1);
+    std::optional<double> compiled_result;
+
+    for (auto& expression : corpus) {
+        compiled_cache.parse(expression);
+        compiled_cache.find(expression, &compiled_result);
+        compiled_cache.find(expression, &compiled_result);
+    }
+
+    results.push_back(benchmark.measure("parse_calculate_jit", nullptr, [&]() {
+        for (auto& expression : corpus) {
+            auto root = compiled_cache.find(expression, &compiled_result);
+            double result_value;
+
+            if (!compiled_result)
+                root->calculate_expression_tree(result_value);
+        }
+    }));
+
+    // 入力された式に対して、実行可能ファイルpolishと同じ処理全体を計測する
+    results.push_back(benchmark.measure("end_to_end", nullptr, [&]() {
+        for (auto& expression : corpus) {
+            process_expression(expression, output, output);
+        }
+    }));
+}
+
+void write_csv(const std::vector<BenchmarkResult>& results, std::ostream& stream)
+{
+    stream << "corpus,phase,expressions,corpus_bytes,passes,ns_per_op,bytes_allocated_per_op,allocations_per_op,ops_per_second,mb_per_second\n";
+
+    for (auto& r : results) {
+        stream
+            << r.corpus << ',' << r.phase << ',' << r.expressions << ',' << r.corpus_bytes << ',' << r.passes << ','
+            << r.ns_per_op << ',' << r.bytes_allocated_per_op << ',' << r.allocations_per_op << ','
+            << r.ops_per_second << ',' << r.megabytes_per_second << '\n';
+    }
+}
+
+void write_json(const std::vector<BenchmarkResult>& results, std::ostream& stream)
+{
+    stream << "[\n";
+
+    for (std::size_t i = 0; i < results.size(); i++) {
+        auto& r = results[i];
+
+        stream
+            << "  { \"corpus\": \"" << r.corpus << "\", \"phase\": \"" << r.phase << "\""
+            << ", \"expressions\": " << r.expressions << ", \"corpus_bytes\": " << r.corpus_bytes << ", \"passes\": " << r.passes
+            << ", \"ns_per_op\": " << r.ns_per_op << ", \"bytes_allocated_per_op\": " << r.bytes_allocated_per_op
+            << ", \"allocations_per_op\": " << r.allocations_per_op << ", \"ops_per_second\": " << r.ops_per_second
+            << ", \"mb_per_second\": " << r.megabytes_per_second << " }"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+
+    stream << "]\n";
+}
+
+const CorpusShape* find_corpus(std::string_view name)
+{
+    for (auto& shape : corpus_shapes) {
+        if (shape.name == name)
+            return &shape;
+    }
+
+    std::cerr << "unknown corpus: " << name << std::endl;
+
+    return nullptr;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    std::string csv_path, json_path;
+    std::vector<const CorpusShape*> shapes;
+    const CorpusShape* generating_shape = nullptr;
+
+    for (auto i = 1; i < argc; i++) {
+        auto arg = std::string_view(argv[i]);
+        auto has_value = i + 1 < argc;
+
+        if ("--csv" == arg && has_value) {
+            csv_path = argv[++i];
+        }
+        else if ("--json" == arg && has_value) {
+            json_path = argv[++i];
+        }
+        else if ("--seed" == arg && has_value) {
+            options.seed = std::stoull(argv[++i]);
+        }
+        else if ("--min-time" == arg && has_value) {
+            options.min_time = std::chrono::milliseconds(std::stoul(argv[++i]));
+        }
+        else if ("--corpus" == arg && has_value) {
+            if (!(shapes.emplace_back(find_corpus(argv[++i]))))
+                return 1;
+        }
+        else if ("--generate" == arg && has_value) {
+            if (!(generating_shape = find_corpus(argv[++i])))
+                return 1;
+        }
+        else if ("--list" == arg) {
+            for (auto& shape : corpus_shapes) {
+                std::cout << shape.name << std::endl;
+            }
+
+            return 0;
+        }
+        else {
+            std::cerr << "usage: polish-bench [--csv <file>] [--json <file>] [--seed <n>] [--min-time <ms>] [--corpus <name>]..." << std::endl;
+            std::cerr << "       polish-bench --generate <name> [--seed <n>]" << std::endl;
+            std::cerr << "       polish-bench --list" << std::endl;
+            return 1;
+        }
+    }
+
+    if (generating_shape) {
+        for (auto& expression : generate_corpus(*generating_shape, options.seed)) {
+            std::cout << expression << '\n';
+        }
+
+        return 0;
+    }
+
+    if (shapes.empty()) {
+        for (auto& shape : corpus_shapes) {
+            shapes.push_back(&shape);
+        }
+    }
+
+    std::vector<BenchmarkResult> results;
+
+    for (auto shape : shapes) {
+        std::cerr << "running: " << shape->name << std::endl;
+        run_benchmarks(options, *shape, results);
+    }
+
+    if (csv_path.empty() && json_path.empty())
+        write_csv(results, std::cout);
+
+    if (!csv_path.empty()) {
+        std::ofstream file(csv_path);
+        write_csv(results, file);
+    }
+
+    if (!json_path.empty()) {
+        std::ofstream file(json_path);
+        write_json(results, file);
+    }
+
+    return 0;
+}
@@ -0,0 +1,491 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// ライブラリの各機能の結果を、同じ結果となるべき別の方法での結果と照合するテスト
+//
+// 使用方法:
+//   polish-check try-parse <polish> <testcase>...
+//     テストケースのファイル(tests/impls/testcases/*.jsonc)の"Input"の値と、それらから1文字ずつ削除した式について、
+//     polish::try_parseの結果を、例外を送出する分割(Node::parse_expression)の結果、
+//     および実行可能ファイル<polish>の標準エラー出力・終了コードと照合する
+//   polish-check incremental [<seed>]
+//     ランダムに生成した式をランダムに編集し、編集のたびにIncrementalParserで分割し直した結果(二分木・エラー)を、
+//     編集後の式をpolish::try_parseで分割した結果と照合する(乱数の種<seed>の既定値は1)
+//   polish-check generators [<seed>]
+//     ランダムに生成した式の二分木について、Node::preorder/inorder/postorderが生成するノードの順序を、
+//     Node::write_preorder/inorder/postorderの出力と照合する
+//     また、深い二分木で巡回を途中で打ち切った場合と、begin()を繰り返し呼び出した場合の動作を検証する
+//
+// すべて一致した場合は0、一致しないものがあった場合は1を返す(一致しなかったものは標準エラー出力に出力する)
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "polish.hpp"
+#include "polish_generator.hpp"
+#include "polish_incremental.hpp"
+#include "polish_testcases.hpp"
+
+using namespace polish;
+
+namespace {
+
+// 一致しなかった数
+std::size_t failure_count = 0;
+
+void report_failure(std::string_view check, std::string_view input, std::string_view detail)
+{
+    failure_count++;
+    std::cerr << check << ": \"" << input << "\": " << detail << std::endl;
+}
+
+// 実行可能ファイルの実行結果
+struct ProcessResult {
+    int exit_code;
+    std::string standard_error;
+};
+
+// 実行可能ファイルpathを実行して標準入力に1行inputを与え、終了コードと標準エラー出力を返す関数
+// (標準出力は破棄する)
+ProcessResult run_process(const std::string& path, const std::string& input)
+{
+    int input_pipe[2], error_pipe[2];
+
+    if (::pipe(input_pipe) < 0 || ::pipe(error_pipe) < 0)
+        throw std::runtime_error("pipe failed");
+
+    auto pid = ::fork();
+
+    if (pid < 0)
+        throw std::runtime_error("fork failed");
+
+    if (0 == pid) {
+        ::dup2(input_pipe[0], STDIN_FILENO);
+        ::dup2(error_pipe[1], STDERR_FILENO);
+
+        if (auto null = std::fopen("/dev/null", "w"))
+            ::dup2(::fileno(null), STDOUT_FILENO);
+
+        ::close(input_pipe[0]);
+        ::close(input_pipe[1]);
+        ::close(error_pipe[0]);
+        ::close(error_pipe[1]);
+
+        ::execl(path.c_str(), path.c_str(), static_cast<char*>(nullptr));
+        ::_exit(127);
+    }
+
+    ::close(input_pipe[0]);
+    ::close(error_pipe[1]);
+
+    // テストケースの式はパイプの容量より十分に短いため、書き込みを終えてから読み込む
+    auto line = input + '\n';
+
+    [[maybe_unused]] auto written = ::write(input_pipe[1], line.data(), line.length());
+
+    ::close(input_pipe[1]);
+
+    ProcessResult result { -1, std::string() };
+    char buffer[256];
+
+    for (ssize_t length; 0 < (length = ::read(error_pipe[0], buffer, sizeof(buffer))); ) {
+        result.standard_error.append(buffer, static_cast<std::size_t>(length));
+    }
+
+    ::close(error_pipe[0]);
+
+    int status;
+
+    if (0 <= ::waitpid(pid, &status, 0) && WIFEXITED(status))
+        result.exit_code = WEXITSTATUS(status);
+
+    return result;
+}
+
+std::string postorder_of(Node& root)
+{
+    std::ostringstream stream;
+
+    root.write_postorder(stream);
+
+    return stream.str();
+}
+
+// エラーの原因codeに対応する、例外のメッセージの先頭部分を返す関数
+std::string_view message_prefix_of(ParseErrorCode code)
+{
+    switch (code) {
+        case ParseErrorCode::empty_expression:   return "empty expression";
+        case ParseErrorCode::unbalanced_bracket: return "unbalanced bracket: ";
+        case ParseErrorCode::empty_bracket:      return "empty bracket: ";
+        case ParseErrorCode::invalid_expression: return "invalid expression: ";
+    }
+
+    return "(unknown error code)";
+}
+
+// 1つの入力inputについて、try_parseの結果を照合する
+void check_try_parse_input(const std::string& polish_path, const std::string& input)
+{
+    constexpr std::string_view check = "try-parse";
+
+    auto parsed = try_parse(input);
+
+    // 例外を送出する分割の結果
+    auto expression = input;
+
+    expression.erase(std::remove(expression.begin(), expression.end(), ' '), expression.end());
+
+    std::unique_ptr<Node> root;
+    std::string exception_message;
+
+    if (expression.empty()) {
+        exception_message = "empty expression";
+    }
+    else {
+        try {
+            root = std::make_unique<Node>(expression);
+            root->parse_expression();
+        }
+        catch (const MalformedExpressionException& err) {
+            root = nullptr;
+            exception_message = err.what();
+        }
+    }
+
+    if (parsed) {
+        if (!root)
+            report_failure(check, input, "try_parse succeeded but parse_expression threw: " + exception_message);
+        else if (postorder_of(**parsed) != postorder_of(*root))
+            report_failure(check, input, "trees differ");
+    }
+    else {
+        auto& error = parsed.error();
+
+        if (root)
+            report_failure(check, input, "try_parse failed but parse_expression succeeded: " + error.message());
+
+        // エラーは空白を除去した式と、その中の範囲を保持する
+        if (error.expression != expression)
+            report_failure(check, input, "error expression differs: " + error.expression);
+
+        if (expression.length() < error.offset || expression.length() - error.offset < error.length)
+            report_failure(check, input, "error range out of expression");
+        else if (error.subexpression() != std::string_view(expression).substr(error.offset, error.length))
+            report_failure(check, input, "subexpression differs from the error range");
+
+        // メッセージは、呼び出すたびに例外のメッセージと同じものとなる
+        if (error.message() != exception_message || error.message() != exception_message)
+            report_failure(check, input, "message differs: " + error.message() + " / " + exception_message);
+
+        // エラーの原因は、例外のメッセージが示す原因と一致する
+        if (!exception_message.starts_with(message_prefix_of(error.code)) || (ParseErrorCode::empty_expression == error.code) != expression.empty())
+            report_failure(check, input, "unexpected error code for: " + exception_message);
+    }
+
+    // 実行可能ファイルは、不正な式の場合にエラーメッセージ(空の式の場合は出力しない)を出力して1を返す
+    auto process = run_process(polish_path, input);
+
+    if (parsed) {
+        if (1 == process.exit_code || !process.standard_error.empty())
+            report_failure(check, input, "polish failed: " + process.standard_error);
+    }
+    else {
+        auto expected = ParseErrorCode::empty_expression == parsed.error().code ? std::string() : parsed.error().message() + '\n';
+
+        if (1 != process.exit_code)
+            report_failure(check, input, "polish exited with " + std::to_string(process.exit_code));
+
+        if (process.standard_error != expected)
+            report_failure(check, input, "polish reported: " + process.standard_error);
+    }
+}
+
+int check_try_parse(const std::string& polish_path, const std::vector<std::string>& testcase_paths)
+{
+    std::size_t checked = 0;
+
+    for (auto& path : testcase_paths) {
+        for (auto& input : read_testcase_file(path)) {
+            check_try_parse_input(polish_path, input);
+            checked++;
+
+            // 1文字ずつ削除した式(多くは不正な式となる)についても照合する
+            for (std::size_t i = 0; i < input.length(); i++) {
+                check_try_parse_input(polish_path, input.substr(0, i) + input.substr(i + 1));
+                checked++;
+            }
+        }
+    }
+
+    std::cout << "try-parse: " << checked << " inputs, " << failure_count << " failures" << std::endl;
+
+    return 0 == failure_count ? 0 : 1;
+}
+
+// 深さdepthまでの、ランダムな式を生成する関数
+std::string generate_expression(std::mt19937& random, int depth)
+{
+    static constexpr std::string_view terms[] = { "1", "22", "x", "3.5", "abc", "0" };
+    static constexpr std::string_view operators = "=+-*/%^";
+
+    if (0 == depth || 0 == random() % 3)
+        return std::string(terms[random() % std::size(terms)]);
+
+    auto left = generate_expression(random, depth - 1);
+    auto operator_char = operators[random() % operators.length()];
+    auto right = generate_expression(random, depth - 1);
+    auto expression = left + operator_char + right;
+
+    switch (random() % 8) {
+        case 0: case 1: return "(" + expression + ")";
+        case 2: return " " + expression + " ";
+        default: return expression;
+    }
+}
+
+std::string preorder_and_postorder_of(Node& root)
+{
+    std::ostringstream stream;
+
+    root.write_preorder(stream);
+    stream << '|';
+    root.write_postorder(stream);
+
+    return stream.str();
+}
+
+int check_incremental(unsigned int seed)
+{
+    constexpr std::string_view check = "incremental";
+    constexpr int expressions = 400;
+    constexpr int edits_per_expression = 60;
+
+    // 編集で挿入する文字列(不正な式となるものを含む)
+    static constexpr std::string_view insertions[] = { "", "1", "+", "(", ")", "2*", "(3-x)", " ", "()", "45", "^", "%2" };
+
+    std::mt19937 random(seed);
+    std::size_t edits = 0, parsed = 0, reused = 0;
+
+    for (auto i = 0; i < expressions; i++) {
+        IncrementalParser parser(generate_expression(random, 6));
+
+        for (auto j = 0; j < edits_per_expression; j++) {
+            auto& expression = parser.expression();
+            bool result;
+
+            if (0 == random() % 5) {
+                // 式全体を置き換える
+                result = parser.update(generate_expression(random, 6));
+            }
+            else {
+                auto offset = random() % (expression.length() + 1);
+                auto removed_length = random() % (std::min<std::size_t>(3, expression.length() - offset) + 1);
+
+                result = parser.edit(offset, removed_length, insertions[random() % std::size(insertions)]);
+            }
+
+            edits++;
+
+            auto expected = try_parse(parser.expression());
+
+            if (result != expected.has_value()) {
+                report_failure(check, parser.expression(), "result differs");
+                continue;
+            }
+
+            if (result) {
+                parsed++;
+                reused += parser.reused_subtrees();
+
+                if (!parser.root() || parser.error())
+                    report_failure(check, parser.expression(), "root or error is inconsistent with the result");
+                else if (preorder_and_postorder_of(*parser.root()) != preorder_and_postorder_of(**expected))
+                    report_failure(check, parser.expression(), "trees differ");
+            }
+            else {
+                auto error = parser.error();
+                auto& expected_error = expected.error();
+
+                if (!error || parser.root())
+                    report_failure(check, parser.expression(), "root or error is inconsistent with the result");
+                else if (error->code != expected_error.code || error->offset != expected_error.offset || error->length != expected_error.length || error->message() != expected_error.message())
+                    report_failure(check, parser.expression(), "errors differ: " + error->message() + " / " + expected_error.message());
+            }
+        }
+    }
+
+    // 編集されていない部分式の部分木が、実際に再利用されていること
+    if (0 == reused)
+        report_failure(check, "", "no subtrees were reused");
+
+    // 式の範囲外の編集は、std::out_of_rangeを送出する
+    try {
+        IncrementalParser parser("1+2");
+
+        parser.edit(4, 0, "x");
+
+        report_failure(check, "1+2", "edit out of range did not throw");
+    }
+    catch (const std::out_of_range&) {
+    }
+
+    std::cout << "incremental: " << edits << " edits (" << parsed << " parsed, " << reused << " subtrees reused), " << failure_count << " failures" << std::endl;
+
+    return 0 == failure_count ? 0 : 1;
+}
+
+// 文字列textを空白で区切った字句の列を返す関数
+std::vector<std::string> split_tokens(std::string_view text)
+{
+    std::vector<std::string> tokens;
+    std::istringstream stream { std::string(text) };
+
+    for (std::string token; stream >> token; ) {
+        tokens.push_back(std::move(token));
+    }
+
+    return tokens;
+}
+
+// ジェネレータgeneratorから、最大でmax_count個までのノードの演算子または項を取り出す関数
+// (max_count個を取り出した時点で、巡回を打ち切る)
+std::vector<std::string> take_tokens(Generator<const Node> generator, std::size_t max_count = std::string::npos)
+{
+    std::vector<std::string> tokens;
+
+    for (auto& node : generator) {
+        if (max_count <= tokens.size())
+            break;
+
+        tokens.emplace_back(node.token());
+    }
+
+    return tokens;
+}
+
+void check_generators_of(const std::string& expression)
+{
+    constexpr std::string_view check = "generators";
+
+    auto parsed = try_parse(expression);
+
+    if (!parsed)
+        return;
+
+    auto& root = **parsed;
+    std::ostringstream preorder, inorder, postorder;
+
+    root.write_preorder(preorder);
+    root.write_postorder(postorder);
+    root.write_inorder(inorder);
+
+    // write_inorderが補う丸括弧を除いて比較する
+    // (生成する式の項は丸括弧を含まないため、丸括弧はすべて補われたものとなる)
+    auto inorder_text = inorder.str();
+
+    std::erase_if(inorder_text, [](char ch) { return '(' == ch || ')' == ch; });
+
+    if (take_tokens(root.preorder()) != split_tokens(preorder.str()))
+        report_failure(check, expression, "preorder differs from write_preorder");
+
+    if (take_tokens(root.inorder()) != split_tokens(inorder_text))
+        report_failure(check, expression, "inorder differs from write_inorder");
+
+    if (take_tokens(root.postorder()) != split_tokens(postorder.str()))
+        report_failure(check, expression, "postorder differs from write_postorder");
+}
+
+int check_generators(unsigned int seed)
+{
+    constexpr std::string_view check = "generators";
+    constexpr int expressions = 2000;
+
+    std::mt19937 random(seed);
+
+    for (auto i = 0; i < expressions; i++) {
+        check_generators_of(generate_expression(random, 8));
+    }
+
+    // 左結合の演算子を連ねた深い二分木(根から左の子ノードをたどると、項まで深さterms - 1となる)
+    constexpr std::size_t terms = 10000;
+    std::string chain = "1";
+
+    for (std::size_t i = 1; i < terms; i++) {
+        chain += "+1";
+    }
+
+    auto parsed = try_parse(chain);
+
+    if (!parsed) {
+        report_failure(check, "1+1+...+1", "failed to parse");
+    }
+    else {
+        auto& root = **parsed;
+
+        // 途中で打ち切った場合は、それまでのノードが正しい順序で生成される
+        if (take_tokens(root.preorder(), 3) != std::vector<std::string> { "+", "+", "+" })
+            report_failure(check, "1+1+...+1", "preorder with early exit differs");
+
+        if (take_tokens(root.inorder(), 3) != std::vector<std::string> { "1", "+", "1" })
+            report_failure(check, "1+1+...+1", "inorder with early exit differs");
+
+        if (take_tokens(root.postorder(), 3) != std::vector<std::string> { "1", "1", "+" })
+            report_failure(check, "1+1+...+1", "postorder with early exit differs");
+
+        // 最後まで取り出した場合は、すべてのノードが1回ずつ生成される
+        if (take_tokens(root.postorder()).size() != 2 * terms - 1)
+            report_failure(check, "1+1+...+1", "postorder did not visit every node");
+
+        // begin()を繰り返し呼び出しても、コルーチンは再開されない
+        auto generator = root.preorder();
+        auto it = generator.begin();
+
+        ++it;
+
+        if (&*generator.begin() != &*it)
+            report_failure(check, "1+1+...+1", "begin() resumed the coroutine again");
+
+        for (; it != generator.end(); ++it) {
+        }
+
+        if (generator.begin() != generator.end())
+            report_failure(check, "1+1+...+1", "begin() after the end resumed the coroutine");
+    }
+
+    std::cout << "generators: " << expressions << " expressions, " << failure_count << " failures" << std::endl;
+
+    return 0 == failure_count ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    auto command = 1 < argc ? std::string_view(argv[1]) : std::string_view();
+
+    if ("try-parse" == command && 2 < argc)
+        return check_try_parse(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+
+    if ("incremental" == command)
+        return check_incremental(2 < argc ? static_cast<unsigned int>(std::stoul(argv[2])) : 1u);
+
+    if ("generators" == command)
+        return check_generators(2 < argc ? static_cast<unsigned int>(std::stoul(argv[2])) : 1u);
+
+    std::cerr << "usage: polish-check try-parse <polish> <testcase>..." << std::endl;
+    std::cerr << "       polish-check incremental [<seed>]" << std::endl;
+    std::cerr << "       polish-check generators [<seed>]" << std::endl;
+
+    return 1;
+}
@@ -0,0 +1,360 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// C言語での実装(../c/polish.c)とC++での実装の性能を、同じ入力に対して処理ごとに比較するハーネス
+//
+// 使用方法:
+//   polish-compare [--margin <percent>] [--min-time <ms>] [--repeat <count>] [--strict] <input>...
+//     --margin: C++での実装がC言語での実装よりこの割合以上遅い場合に、その処理を遅いものとして報告する(既定値は25%)
+//     --min-time: 各処理を1回計測する最小の時間(既定値は40ms)
+//     --repeat: 各処理を両方の実装で交互に計測する回数(既定値は5回)
+//               計測時間の揺らぎの影響を抑えるため、それぞれの実装で最も短かった計測結果を比較する
+//     --strict: 遅いものとして報告した処理がある場合に、失敗とする
+//     input: 入力とする式のファイル
+//            拡張子が.jsoncの場合はテストケースのファイル(tests/impls/testcases/*.jsonc)として"Input"の値を、
+//            それ以外の場合は1行を1つの式として読み込む
+//
+// 比較結果はCSV形式で標準出力に出力する
+// --strictを指定して、遅いものとして報告した処理がある場合は1、それ以外の場合は0を返す
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "polish.hpp"
+#include "polish_testcases.hpp"
+
+using namespace polish;
+
+// C言語での実装の各処理(polish_compare_c.cで定義する)
+extern "C" {
+    void* polish_c_parse(const char* expression);
+    void polish_c_write_postorder(void* root);
+    void polish_c_write_inorder(void* root);
+    void polish_c_write_preorder(void* root);
+    bool polish_c_calculate(void* root, double* result_value);
+    int polish_c_run(const char* expression);
+}
+
+// 比較に用いる入力
+struct InputGroup {
+    std::string name;                           // 入力のファイル名
+    std::vector<std::string> expressions;       // 処理全体の比較に用いる式
+    std::vector<std::string> parsable;          // 空白を除去した式のうち、両方の実装で二分木へと分割できるもの
+    std::size_t skipped = 0;                    // いずれかの実装で分割できないため、処理ごとの比較から除外した式の数
+};
+
+// 1つの処理の比較結果
+struct ComparisonResult {
+    std::string group;
+    std::string_view phase;
+    std::size_t expressions;
+    double c_ns_per_op;
+    double cpp_ns_per_op;
+    double c_mb_per_second;
+    double cpp_mb_per_second;
+    bool slower;            // C++での実装が許容範囲を超えて遅いかどうか
+};
+
+// 計測中の標準出力・標準エラーへの出力を破棄するクラス
+// (両方の実装とも、各記法への変換結果を標準出力に出力するため、計測中は/dev/nullに向ける)
+class OutputSilencer {
+public:
+    OutputSilencer()
+    {
+        std::fflush(stdout);
+        std::fflush(stderr);
+
+        saved_stdout = ::dup(STDOUT_FILENO);
+        saved_stderr = ::dup(STDERR_FILENO);
+
+        auto null_fd = ::open("/dev/null", O_WRONLY);
+
+        ::dup2(null_fd, STDOUT_FILENO);
+        ::dup2(null_fd, STDERR_FILENO);
+        ::close(null_fd);
+    }
+
+    ~OutputSilencer()
+    {
+        std::cout.flush();
+        std::fflush(stdout);
+        std::fflush(stderr);
+
+        ::dup2(saved_stdout, STDOUT_FILENO);
+        ::dup2(saved_stderr, STDERR_FILENO);
+        ::close(saved_stdout);
+        ::close(saved_stderr);
+    }
+
+private:
+    int saved_stdout, saved_stderr;
+};
+
+InputGroup read_input_group(const std::string& path)
+{
+    std::ifstream file(path);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    InputGroup group { path.substr(path.find_last_of('/') + 1), {}, {}, 0 };
+
+    if (path.ends_with(".jsonc")) {
+        group.expressions = read_testcase_inputs(content);
+    }
+    else {
+        std::istringstream lines(content);
+
+        for (std::string line; std::getline(lines, line); ) {
+            group.expressions.push_back(line);
+        }
+    }
+
+    // 処理ごとの比較には、空白を除去した上で両方の実装で分割できる式のみを用いる
+    OutputSilencer silencer;
+
+    for (auto expression : group.expressions) {
+        expression.erase(std::remove(expression.begin(), expression.end(), ' '), expression.end());
+
+        auto parsable = !expression.empty() && polish_c_parse(expression.c_str());
+
+        if (parsable) {
+            try {
+                Node(expression).parse_expression();
+            }
+            catch (const MalformedExpressionException&) {
+                parsable = false;
+            }
+        }
+
+        if (parsable)
+            group.parsable.push_back(std::move(expression));
+        else
+            group.skipped++;
+    }
+
+    return group;
+}
+
+// 計測の設定
+struct CompareOptions {
+    double margin = 0.25;
+    std::chrono::nanoseconds min_time = std::chrono::milliseconds(40);
+    int repeat = 5;
+    bool strict = false;
+};
+
+// 式ごとにprepareを呼び出した後(計測に含めない)、runの処理時間を計測し、
+// すべての式に対する合計の計測時間がmin_timeに達するまで繰り返して、式1つあたりの処理時間を返す関数
+double measure(
+    const CompareOptions& options,
+    const std::vector<std::string>& expressions,
+    const std::function<void(const std::string&)>& prepare,
+    const std::function<void(const std::string&)>& run
+)
+{
+    if (expressions.empty())
+        return 0.0;
+
+    std::chrono::nanoseconds elapsed { 0 };
+    std::uint64_t ops = 0;
+
+    while (elapsed < options.min_time || 0 == ops) {
+        for (auto& expression : expressions) {
+            if (prepare)
+                prepare(expression);
+
+            auto started_at = std::chrono::steady_clock::now();
+
+            run(expression);
+
+            elapsed += std::chrono::steady_clock::now() - started_at;
+            ops++;
+        }
+    }
+
+    return static_cast<double>(elapsed.count()) / ops;
+}
+
+void compare_group(const CompareOptions& options, const InputGroup& group, std::vector<ComparisonResult>& results)
+{
+    std::unique_ptr<Node> cpp_root;
+    void* c_root = nullptr;
+    double result_value;
+
+    auto c_parse = [&](const std::string& expression) { c_root = polish_c_parse(expression.c_str()); };
+    auto cpp_parse = [&](const std::string& expression) {
+        cpp_root = std::make_unique<Node>(expression);
+        cpp_root->parse_expression();
+    };
+
+    using Operation = std::function<void(const std::string&)>;
+
+    // 両方の実装でrepeat回ずつ交互に計測し、それぞれ最も短かった処理時間を比較する
+    // (他のプロセスの影響などで計測時間が長くなった回を除外するため)
+    auto add_result = [&](
+        std::string_view phase,
+        const std::vector<std::string>& expressions,
+        const Operation& c_prepare,
+        const Operation& c_run,
+        const Operation& cpp_prepare,
+        const Operation& cpp_run
+    ) {
+        // 比較に用いる式がない処理は報告しない
+        if (expressions.empty())
+            return;
+
+        auto c_ns = 0.0, cpp_ns = 0.0;
+
+        for (auto i = 0; i < std::max(1, options.repeat); i++) {
+            auto c_measured = measure(options, expressions, c_prepare, c_run);
+            auto cpp_measured = measure(options, expressions, cpp_prepare, cpp_run);
+
+            c_ns = 0 == i ? c_measured : std::min(c_ns, c_measured);
+            cpp_ns = 0 == i ? cpp_measured : std::min(cpp_ns, cpp_measured);
+        }
+
+        std::uint64_t bytes = 0;
+
+        for (auto& expression : expressions) {
+            bytes += expression.length();
+        }
+
+        // 1秒あたりに処理できる式の長さ(MB)
+        auto mb_per_second = [&](double ns) {
+            return 0.0 < ns ? bytes / (ns * expressions.size()) * 1e3 : 0.0;
+        };
+
+        results.push_back(ComparisonResult {
+            group.name,
+            phase,
+            expressions.size(),
+            c_ns,
+            cpp_ns,
+            mb_per_second(c_ns),
+            mb_per_second(cpp_ns),
+            c_ns * (1.0 + options.margin) < cpp_ns,
+        });
+    };
+
+    OutputSilencer silencer;
+
+    // 二分木への分割
+    // (C++での実装では、前回分割した二分木の破棄は計測に含めない)
+    add_result(
+        "parse",
+        group.parsable,
+        nullptr, c_parse,
+        [&](const std::string&) { cpp_root = nullptr; }, cpp_parse
+    );
+
+    // 各記法への変換(C言語での実装に合わせ、C++での実装でも標準出力に出力して改行する)
+    add_result(
+        "write_postorder",
+        group.parsable,
+        c_parse, [&](const std::string&) { polish_c_write_postorder(c_root); },
+        cpp_parse, [&](const std::string&) { cpp_root->write_postorder(std::cout); std::cout << '\n'; }
+    );
+    add_result(
+        "write_inorder",
+        group.parsable,
+        c_parse, [&](const std::string&) { polish_c_write_inorder(c_root); },
+        cpp_parse, [&](const std::string&) { cpp_root->write_inorder(std::cout); std::cout << '\n'; }
+    );
+    add_result(
+        "write_preorder",
+        group.parsable,
+        c_parse, [&](const std::string&) { polish_c_write_preorder(c_root); },
+        cpp_parse, [&](const std::string&) { cpp_root->write_preorder(std::cout); std::cout << '\n'; }
+    );
+
+    // 式全体の値の計算(二分木を変更するため、毎回分割し直した二分木に対して計測する)
+    add_result(
+        "calculate",
+        group.parsable,
+        c_parse, [&](const std::string&) { polish_c_calculate(c_root, &result_value); },
+        cpp_parse, [&](const std::string&) { cpp_root->calculate_expression_tree(result_value); }
+    );
+
+    // 入力された式に対する処理全体(不正な式も含む)
+    add_result(
+        "end_to_end",
+        group.expressions,
+        nullptr, [&](const std::string& expression) { polish_c_run(expression.c_str()); },
+        nullptr, [&](const std::string& expression) { process_expression(expression, std::cout, std::cerr); }
+    );
+}
+
+int main(int argc, char* argv[])
+{
+    CompareOptions options;
+    std::vector<std::string> inputs;
+
+    for (auto i = 1; i < argc; i++) {
+        auto arg = std::string_view(argv[i]);
+
+        if ("--margin" == arg && i + 1 < argc)
+            options.margin = std::stod(argv[++i]) / 100.0;
+        else if ("--min-time" == arg && i + 1 < argc)
+            options.min_time = std::chrono::milliseconds(std::stoul(argv[++i]));
+        else if ("--repeat" == arg && i + 1 < argc)
+            options.repeat = std::stoi(argv[++i]);
+        else if ("--strict" == arg)
+            options.strict = true;
+        else
+            inputs.emplace_back(arg);
+    }
+
+    if (inputs.empty()) {
+        std::cerr << "usage: polish-compare [--margin <percent>] [--min-time <ms>] [--repeat <count>] [--strict] <input>..." << std::endl;
+        return 1;
+    }
+
+    std::vector<ComparisonResult> results;
+
+    for (auto& path : inputs) {
+        auto group = read_input_group(path);
+
+        std::cerr << "comparing: " << group.name << " (" << group.expressions.size() << " expressions, "
+                  << group.skipped << " skipped from per-phase comparison)" << std::endl;
+
+        compare_group(options, group, results);
+    }
+
+    std::cout << "group,phase,expressions,c_ns_per_op,cpp_ns_per_op,cpp_to_c_ratio,c_mb_per_second,cpp_mb_per_second,status\n";
+
+    auto slower_count = 0;
+
+    for (auto& r : results) {
+        std::cout
+            << r.group << ',' << r.phase << ',' << r.expressions << ','
+            << r.c_ns_per_op << ',' << r.cpp_ns_per_op << ',' << (0.0 < r.c_ns_per_op ? r.cpp_ns_per_op / r.c_ns_per_op : 0.0) << ','
+            << r.c_mb_per_second << ',' << r.cpp_mb_per_second << ','
+            << (r.slower ? "slower" : "ok") << '\n';
+
+        if (r.slower)
+            slower_count++;
+    }
+
+    std::cout.flush();
+
+    if (0 < slower_count) {
+        std::cerr << slower_count << " phase(s) where the C++ implementation is slower than the C implementation by more than "
+                  << options.margin * 100.0 << "%" << std::endl;
+
+        // 計測結果は他のプロセスの負荷などで揺らぐため、失敗とするのは--strictを指定した場合のみとする
+        if (options.strict)
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// C言語での実装(../c/polish.c)の各処理を、性能比較ハーネスpolish-compareから呼び出すための関数群
+// (polish.cのmain関数は使用しないため、名前を変えて取り込む)
+#define main polish_c_main
+#include "../c/polish.c"
+#undef main
+
+// 式expressionを二分木へと分割し、根ノードを返す関数
+// (C言語での実装はノードをあらかじめ確保した配列から割り当てるため、同時に保持できる二分木は1つのみとなる)
+// 式が長すぎる場合や不正な形式の場合はNULLを返す
+void *polish_c_parse(const char *const expression)
+{
+    // 確保済みのノードをすべて未使用に戻す
+    nb_node_used = 0;
+
+    if (MAX_EXP_LEN <= strlen(expression))
+        return NULL;
+
+    Node *root = create_node();
+
+    memset(root->exp, 0, MAX_EXP_LEN);
+    strcpy(root->exp, expression);
+
+    if (!validate_bracket_balance(root->exp))
+        return NULL;
+
+    if (!parse_expression(root))
+        return NULL;
+
+    return root;
+}
+
+void polish_c_write_postorder(void *const root) { print_postorder((Node *)root); }
+void polish_c_write_inorder(void *const root) { print_inorder((Node *)root); }
+void polish_c_write_preorder(void *const root) { print_preorder((Node *)root); }
+
+bool polish_c_calculate(void *const root, double *const result_value)
+{
+    return calculate_expression_tree((Node *)root, result_value);
+}
+
+// polish.cのmain関数と同じ処理を、標準入力から読み込む代わりに式expressionに対して行う関数
+int polish_c_run(const char *const expression)
+{
+    nb_node_used = 0;
+
+    Node *root = create_node();
+
+    // main関数と同様に、MAX_EXP_LEN - 1文字までを入力された式とする
+    memset(root->exp, 0, MAX_EXP_LEN);
+    strncpy(root->exp, expression, MAX_EXP_LEN - 1);
+
+    if (0 == remove_space(root->exp))
+        return 1;
+
+    if (!validate_bracket_balance(root->exp))
+        return 1;
+
+    printf("expression: %s\n", root->exp);
+
+    if (!parse_expression(root))
+        return 1;
+
+    printf("reverse polish notation: ");
+    print_postorder(root);
+
+    printf("infix notation: ");
+    print_inorder(root);
+
+    printf("polish notation: ");
+    print_preorder(root);
+
+    double result_value;
+
+    if (calculate_expression_tree(root, &result_value)) {
+        printf("calculated result: %.17g\n", result_value);
+        return 0;
+    }
+    else {
+        printf("calculated expression: ");
+        print_inorder(root);
+        return 2;
+    }
+}
@@ -0,0 +1,344 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+#include "polish_csv.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <format>
+#include <optional>
+#include <stdexcept>
+
+namespace polish {
+
+namespace {
+
+// 入力を一定の大きさのブロックごとに読み込み、完全な行の並びを返すクラス
+class BlockReader {
+public:
+    BlockReader(std::istream& input, std::size_t block_size)
+        : input(input), block_size(block_size)
+    {
+    }
+
+    // 読み込んだブロックのうち、改行で終わる行の並びをlinesに設定するメソッド
+    // (linesは次に呼び出すまで有効で、入力の最後の行は改行で終わらなくてもよい)
+    // 入力が終了した場合はfalseを返す
+    bool next(std::string_view& lines)
+    {
+        // 前回返した行の並びを破棄し、続く行の途中までを残す
+        buffer.erase(0, consumed);
+        consumed = 0;
+
+        for (;;) {
+            if (end_of_input) {
+                if (buffer.empty())
+                    return false;
+
+                lines = buffer;
+                consumed = buffer.length();
+                return true;
+            }
+
+            auto length = buffer.length();
+
+            buffer.resize(length + block_size);
+            input.read(buffer.data() + length, static_cast<std::streamsize>(block_size));
+            buffer.resize(length + static_cast<std::size_t>(input.gcount()));
+
+            if (!input)
+                end_of_input = true;
+
+            // ブロック中に行の終わりがない場合は、次のブロックを続けて読み込む
+            if (auto last = buffer.rfind('\n'); std::string::npos != last) {
+                lines = std::string_view(buffer).substr(0, last + 1);
+                consumed = last + 1;
+                return true;
+            }
+        }
+    }
+
+private:
+    std::istream& input;
+    std::size_t block_size;
+    std::string buffer;
+    std::size_t consumed = 0;
+    bool end_of_input = false;
+};
+
+// 行の並びlinesから先頭の1行を取り出して返す(行末の\rは取り除く)
+std::string_view take_line(std::string_view& lines) noexcept
+{
+    auto end = lines.find('\n');
+    auto line = lines.substr(0, end);
+
+    lines.remove_prefix(std::string_view::npos == end ? lines.length() : end + 1);
+
+    if (line.ends_with('\r'))
+        line.remove_suffix(1);
+
+    return line;
+}
+
+// フィールドの前後の空白を取り除いて返す
+std::string_view trim_field(std::string_view field) noexcept
+{
+    auto first = field.find_first_not_of(' ');
+
+    if (std::string_view::npos == first)
+        return {};
+
+    return field.substr(first, field.find_last_not_of(' ') - first + 1);
+}
+
+// フィールドを数値化する
+// Node::parse_numberと同じ変換を行うが、空のフィールドと範囲外の値は数値でないものとする
+bool parse_field(std::string_view field, double& number) noexcept
+{
+    auto [ptr, ec] = std::from_chars(field.data(), field.data() + field.length(), number);
+
+    return !field.empty() && std::errc() == ec && field.data() + field.length() == ptr;
+}
+
+// 左右の列の値leftとrightをrows行分演算し、結果をleftに格納する
+// (演算子ごとに個別のループとすることで、コンパイラによるベクトル化を可能にする)
+template <typename Operation>
+void apply(double* left, const double* right, std::size_t rows, Operation operation) noexcept
+{
+    for (std::size_t i = 0; i < rows; i++) {
+        left[i] = operation(left[i], right[i]);
+    }
+}
+
+} // namespace
+
+ColumnarExpression::ColumnarExpression(const Node& root, const std::vector<std::string>& columns)
+{
+    std::size_t depth = 0;
+
+    // 二分木を後行順序で巡回し、命令列に変換する
+    auto flatten = [&](auto& self, const Node& node) -> void {
+        if (!node.left || !node.right) {
+            Instruction instruction { Instruction::Kind::constant, '\0', 0.0, 0 };
+
+            // 数値として扱える項は定数とし、それ以外は同じ名前の列を参照する記号とする
+            if (!Node::parse_number(node.expression, instruction.value)) {
+                auto column = std::find(columns.begin(), columns.end(), node.expression);
+
+                if (columns.end() == column)
+                    throw std::invalid_argument(std::format("unknown column: {}", node.expression));
+
+                auto index = static_cast<std::size_t>(std::distance(columns.begin(), column));
+                auto slot = std::find(referenced.begin(), referenced.end(), index);
+
+                instruction.kind = Instruction::Kind::column;
+                instruction.column = static_cast<std::size_t>(std::distance(referenced.begin(), slot));
+
+                if (referenced.end() == slot)
+                    referenced.push_back(index);
+            }
+
+            instructions.push_back(instruction);
+            max_depth = std::max(max_depth, ++depth);
+            return;
+        }
+
+        if (!Operators::is_evaluable<double>(node.expression.front()))
+            throw std::invalid_argument(std::format("cannot evaluate operator: {}", node.expression));
+
+        self(self, *node.left);
+        self(self, *node.right);
+
+        instructions.push_back(Instruction { Instruction::Kind::operation, node.expression.front(), 0.0, 0 });
+        depth--;
+    };
+
+    flatten(flatten, root);
+}
+
+void ColumnarExpression::evaluate(const std::vector<std::vector<double>>& values, std::size_t rows, std::vector<double>& results)
+{
+    if (stack.size() < max_depth)
+        stack.resize(max_depth);
+
+    std::size_t depth = 0;
+
+    for (auto& instruction : instructions) {
+        switch (instruction.kind) {
+            case Instruction::Kind::constant:
+                stack[depth++].assign(rows, instruction.value);
+                break;
+
+            case Instruction::Kind::column:
+                stack[depth++].assign(values[instruction.column].begin(), values[instruction.column].begin() + rows);
+                break;
+
+            case Instruction::Kind::operation: {
+                auto left = stack[depth - 2].data();
+                auto right = stack[depth - 1].data();
+
+                // 演算子の特性(OperatorTraits)から、演算子ごとのループを生成する
+                Operators::visit(instruction.operator_char, [&]<typename Traits>() {
+                    if constexpr (EvaluableOperator<Traits, double>) {
+                        apply(left, right, rows, [](double l, double r) { return Traits::evaluate(l, r); });
+                        return true;
+                    }
+                    else {
+                        return false;
+                    }
+                });
+
+                depth--;
+                break;
+            }
+        }
+    }
+
+    results.assign(stack[0].begin(), stack[0].begin() + rows);
+}
+
+int process_csv(
+    std::string_view expression,
+    std::istream& input,
+    std::ostream& output,
+    std::ostream& error,
+    std::size_t batch_size
+)
+{
+    std::unique_ptr<Node> root;
+
+    try {
+        root = parse(expression);
+    }
+    catch (const MalformedExpressionException& err) {
+        error << err.what() << std::endl;
+        return 1;
+    }
+
+    BlockReader reader(input, csv_block_size);
+    std::string_view lines;
+    std::optional<ColumnarExpression> program;
+    std::vector<int> slot_of_field;  // フィールドの位置ごとの、参照する列での位置(参照しない場合は-1)
+
+    // 1行目を列の名前として読み込み、式を命令列に変換する
+    if (reader.next(lines)) {
+        auto header = take_line(lines);
+        std::vector<std::string> columns;
+
+        for (auto rest = header; ; ) {
+            auto comma = rest.find(',');
+
+            columns.emplace_back(trim_field(rest.substr(0, comma)));
+
+            if (std::string_view::npos == comma)
+                break;
+
+            rest.remove_prefix(comma + 1);
+        }
+
+        try {
+            program.emplace(*root, columns);
+        }
+        catch (const std::invalid_argument& err) {
+            error << err.what() << std::endl;
+            return 1;
+        }
+
+        slot_of_field.assign(columns.size(), -1);
+
+        for (std::size_t slot = 0; slot < program->referenced_columns().size(); slot++) {
+            slot_of_field[program->referenced_columns()[slot]] = static_cast<int>(slot);
+        }
+    }
+    else {
+        error << "empty csv" << std::endl;
+        return 1;
+    }
+
+    auto slot_count = program->referenced_columns().size();
+    std::vector<std::vector<std::string_view>> fields(slot_count);  // 参照する列ごとの、バッチ内の各行のフィールド
+    std::vector<std::vector<double>> values(slot_count);            // 参照する列ごとの、バッチ内の各行の値
+    std::vector<unsigned char> calculable;                          // バッチ内の各行の値を計算できるかどうか
+    std::vector<double> results;
+    std::size_t rows = 0;
+    std::size_t incalculable_rows = 0;
+
+    for (auto& column : fields) {
+        column.reserve(batch_size);
+    }
+
+    // バッチ内の各行を列ごとに数値化して計算し、結果を出力する
+    auto flush = [&]() {
+        calculable.assign(rows, 1);
+
+        for (std::size_t slot = 0; slot < slot_count; slot++) {
+            values[slot].resize(rows);
+
+            for (std::size_t i = 0; i < rows; i++) {
+                if (!parse_field(fields[slot][i], values[slot][i]))
+                    calculable[i] = 0;
+            }
+
+            fields[slot].clear();
+        }
+
+        program->evaluate(values, rows, results);
+
+        for (std::size_t i = 0; i < rows; i++) {
+            if (calculable[i]) {
+                output << Node::format_number(results[i]);
+            }
+            else {
+                incalculable_rows++;
+            }
+
+            output << '\n';
+        }
+
+        rows = 0;
+    };
+
+    output << "result\n";
+
+    do {
+        while (!lines.empty()) {
+            auto line = take_line(lines);
+
+            // 空の行は読み飛ばす
+            if (line.empty())
+                continue;
+
+            // 参照する列のフィールドのみを切り出す(フィールドが足りない場合は空のフィールドとする)
+            for (auto& column : fields) {
+                column.emplace_back();
+            }
+
+            std::size_t index = 0;
+
+            for (auto rest = line; index < slot_of_field.size(); index++) {
+                auto comma = rest.find(',');
+
+                if (0 <= slot_of_field[index])
+                    fields[slot_of_field[index]][rows] = trim_field(rest.substr(0, comma));
+
+                if (std::string_view::npos == comma)
+                    break;
+
+                rest.remove_prefix(comma + 1);
+            }
+
+            if (batch_size <= ++rows)
+                flush();
+        }
+
+        // ブロック内の行を参照しているため、次のブロックを読み込む前に計算する
+        if (0 < rows)
+            flush();
+    } while (reader.next(lines));
+
+    output.flush();
+
+    return 0 < incalculable_rows ? 2 : 0;
+}
+
+} // namespace polish
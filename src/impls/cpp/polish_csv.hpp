@@ -0,0 +1,81 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// 記号を含む式を、CSVファイルの各行に適用して計算するためのヘッダ
+//
+// CSVファイルの1行目を列の名前(ヘッダ)とし、式中の記号を同じ名前の列の値に置き換えて、行ごとに式の値を計算する
+// 例:式"(P*R)/(1-D)"と、ヘッダが"P,R,D"のCSVファイル
+//
+// 入力は一定の大きさのブロックごとに読み込み、計算は一定の行数(バッチ)ごとに列単位で行う
+// (列の値をまとめて数値化し、演算も列全体に対してまとめて行う)
+// そのため、使用するメモリの量はCSVファイルの大きさによらず、ブロックとバッチの大きさで決まる
+//
+// フィールドは引用符で囲まない形式のみを扱い、フィールドの前後の空白と行末の\rは無視する
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "polish.hpp"
+
+namespace polish {
+
+// 二分木を、列ごとの値をまとめて計算する命令列に変換したもの
+class ColumnarExpression {
+public:
+    // 分割済みの二分木rootを変換するコンストラクタ
+    // 式中の記号は、列の名前columnsのうち同じ名前の列を参照するものとする
+    // 数値でも列の名前でもない項を含む場合や、計算できない演算子('=')を含む場合はstd::invalid_argumentを送出する
+    ColumnarExpression(const Node& root, const std::vector<std::string>& columns);
+
+    // 式が参照する列の位置(columnsでの位置)を返すメソッド
+    const std::vector<std::size_t>& referenced_columns() const noexcept { return referenced; }
+
+    // 参照する列の値valuesを用いて、rows行分の式の値をresultsに計算するメソッド
+    // (values[k]は、referenced_columns()のk番目の列のrows行分の値とする)
+    // 計算途中の値を保持する領域を再利用するため、同じインスタンスを複数のスレッドから同時に使用することはできない
+    void evaluate(const std::vector<std::vector<double>>& values, std::size_t rows, std::vector<double>& results);
+
+private:
+    // 後行順序(帰りがけ順)に並べた命令
+    struct Instruction {
+        enum class Kind { constant, column, operation };
+
+        Kind kind;
+        char operator_char;     // 演算の場合は演算子
+        double value;           // 定数の場合はその値
+        std::size_t column;     // 列の場合は、referencedでの位置
+    };
+
+    std::vector<Instruction> instructions;
+    std::vector<std::size_t> referenced;
+    std::size_t max_depth = 0;  // 計算に必要なスタックの深さ
+
+    // 計算途中の列の値を保持するスタック(evaluateの呼び出しごとに確保しないよう、再利用する)
+    std::vector<std::vector<double>> stack;
+};
+
+// CSVファイルを読み込むブロックの大きさと、まとめて計算する行数の既定値
+constexpr std::size_t csv_block_size = 1024 * 1024;
+constexpr std::size_t csv_default_batch_size = 4096;
+
+// 式expressionを、CSVファイルinputの各行に適用して計算し、その結果を1列のCSVとしてoutputに出力する関数
+// 出力の1行目は"result"とし、参照する列の値が数値でない行は空の値とする
+// 式が不正な形式の場合や、CSVファイルに式中の記号と同じ名前の列がない場合は、エラーメッセージをerrorに出力する
+// 戻り値はpolishの終了コードと同じで、次の値を返す
+//   0: すべての行で式の値を計算できた場合
+//   1: 式が不正な形式の場合、または式をCSVファイルに適用できない場合
+//   2: 式の値を計算できなかった行がある場合
+int process_csv(
+    std::string_view expression,
+    std::istream& input,
+    std::ostream& output,
+    std::ostream& error,
+    std::size_t batch_size = csv_default_batch_size
+);
+
+} // namespace polish
@@ -0,0 +1,135 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// 値を1つずつ生成するコルーチン(ジェネレータ)のためのヘッダ
+//
+// 生成される値は、イテレータを進めた時点で初めてコルーチンを再開して求める
+// そのため、必要な数の値を取り出した時点で巡回を打ち切ることができ、打ち切った以降の値を求める処理は一切行われない
+// (std::generatorを使用できない環境でも使用できるよう、必要な機能のみを実装する)
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace polish {
+
+// 型Tの値への参照を生成するジェネレータ
+// co_yieldで与えた値への参照を、範囲for文などで順に取り出すことができる(取り出せるのは1回のみ)
+template <typename T>
+class Generator {
+public:
+    struct promise_type {
+        T* current = nullptr;   // 直前にco_yieldで与えられた値
+
+        Generator get_return_object() noexcept { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+        // 最初の値は、begin()を呼び出した時点で求める
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+
+        std::suspend_always yield_value(T& value) noexcept
+        {
+            current = std::addressof(value);
+            return {};
+        }
+
+        void return_void() noexcept {}
+
+        // コルーチン内で発生した例外は、コルーチンを再開した側(イテレータを進めた側)に送出する
+        void unhandled_exception() { throw; }
+    };
+
+    // 生成された値を順に取り出すイテレータ
+    class iterator {
+    public:
+        using iterator_concept = std::input_iterator_tag;
+        using value_type = std::remove_cv_t<T>;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() noexcept = default;
+
+        T& operator*() const noexcept { return *handle.promise().current; }
+        T* operator->() const noexcept { return handle.promise().current; }
+
+        // コルーチンを再開し、次の値を求める
+        iterator& operator++()
+        {
+            handle.resume();
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        // コルーチンが終了した(すべての値を生成し終えた)場合に、終端と等しくなる
+        friend bool operator==(const iterator& it, std::default_sentinel_t) noexcept { return it.handle.done(); }
+
+    private:
+        friend class Generator;
+
+        explicit iterator(std::coroutine_handle<promise_type> handle) noexcept
+            : handle(handle)
+        {
+        }
+
+        std::coroutine_handle<promise_type> handle = nullptr;
+    };
+
+    Generator(Generator&& other) noexcept
+        : handle(std::exchange(other.handle, nullptr)), started(std::exchange(other.started, false))
+    {
+    }
+
+    Generator& operator=(Generator&& other) noexcept
+    {
+        if (this != &other) {
+            if (handle)
+                handle.destroy();
+
+            handle = std::exchange(other.handle, nullptr);
+            started = std::exchange(other.started, false);
+        }
+
+        return *this;
+    }
+
+    Generator(const Generator&) = delete;
+    Generator& operator=(const Generator&) = delete;
+
+    // 値を取り出し終える前に破棄した場合は、コルーチンをその時点で破棄する(以降の値は求めない)
+    ~Generator()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    // コルーチンを開始し、最初の値を指すイテレータを返すメソッド
+    // コルーチンを開始するのは最初の呼び出しのみとし、2回目以降の呼び出しでは再開せずに、
+    // 現在の値(すべての値を生成し終えている場合は終端)を指すイテレータを返す
+    iterator begin()
+    {
+        if (!started && !handle.done()) {
+            started = true;
+            handle.resume();
+        }
+
+        return iterator(handle);
+    }
+
+    std::default_sentinel_t end() const noexcept { return std::default_sentinel; }
+
+private:
+    explicit Generator(std::coroutine_handle<promise_type> handle) noexcept
+        : handle(handle)
+    {
+    }
+
+    std::coroutine_handle<promise_type> handle;
+    bool started = false;   // begin()でコルーチンを開始したかどうか
+};
+
+} // namespace polish
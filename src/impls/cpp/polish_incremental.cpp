@@ -0,0 +1,220 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+#include "polish_incremental.hpp"
+#include "polish_stats.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace polish {
+
+IncrementalParser::IncrementalParser(std::string expression)
+{
+    update(std::move(expression));
+}
+
+bool IncrementalParser::edit(std::size_t offset, std::size_t removed_length, std::string_view inserted_text)
+{
+    if (text.length() < offset || text.length() - offset < removed_length)
+        throw std::out_of_range("edit out of range");
+
+    text.replace(offset, removed_length, inserted_text);
+
+    return reparse();
+}
+
+bool IncrementalParser::update(std::string expression)
+{
+    text = std::move(expression);
+
+    return reparse();
+}
+
+bool IncrementalParser::reparse()
+{
+    PhaseTimer timer(Phase::parse);
+
+    // 編集中の式から空白を除去する
+    source.clear();
+
+    std::copy_if(
+        text.begin(),
+        text.end(),
+        std::back_inserter(source),
+        [](char ch) { return ' ' != ch; }
+    );
+
+    reused = 0;
+    parse_error.reset();
+
+    if (tree && source == tree_source)
+        // 前回分割できた式から変更がない場合は、二分木全体をそのまま用いる
+        return true;
+
+    if (0 == source.length()) {
+        parse_error = ParseError { ParseErrorCode::empty_expression, 0, 0, std::move(source) };
+        return false;
+    }
+
+    if (!Node::is_bracket_balanced(source)) {
+        auto length = source.length();
+
+        parse_error = ParseError { ParseErrorCode::unbalanced_bracket, 0, length, std::move(source) };
+        return false;
+    }
+
+    // 前回分割できた式と一致する先頭部分・末尾部分の長さを求める
+    // (前回分割できた二分木がない場合は、式全体を編集された範囲とする)
+    auto common_length = tree ? std::min(source.length(), tree_source.length()) : 0;
+
+    unchanged_prefix = static_cast<std::size_t>(
+        std::mismatch(source.begin(), source.begin() + common_length, tree_source.begin()).first - source.begin()
+    );
+    unchanged_suffix = static_cast<std::size_t>(
+        std::mismatch(source.rbegin(), source.rbegin() + (common_length - unchanged_prefix), tree_source.rbegin()).first - source.rbegin()
+    );
+
+    std::unique_ptr<Node> root;
+    Node::ParseFailure failure;
+
+    splits.clear();
+    moved.clear();
+
+    if (!build(root, source, failure)) {
+        // 再利用した部分木を前回分割できた二分木に戻し、次に分割し直す際に再利用できるようにする
+        for (auto it = moved.rbegin(); it != moved.rend(); it++) {
+            *it->first = std::move(*it->second);
+        }
+
+        // (空白を除去した式は分割し直すたびに作成し直すため、エラーに移す)
+        reused = 0;
+        parse_error = Node::make_parse_error(std::move(source), failure);
+
+        return false;
+    }
+
+    tree = std::move(root);
+    tree_source = source;
+
+    return true;
+}
+
+bool IncrementalParser::build(std::unique_ptr<Node>& slot, std::string_view expression, Node::ParseFailure& failure)
+{
+    auto begin = static_cast<std::size_t>(expression.data() - source.data());
+    auto end = begin + expression.length();
+    auto changed_end = source.length() - unchanged_suffix; // 編集された範囲の終端
+
+    if (end <= unchanged_prefix || changed_end <= begin) {
+        // 編集されていない範囲にある部分式の場合は、前回分割できた二分木から同じ範囲のノードを探す
+        // (末尾部分にある場合は、編集によって変化した式の長さの分だけ位置がずれる)
+        auto shift = changed_end <= begin ? tree_source.length() - source.length() : 0;
+
+        if (auto found = find(Span { begin + shift, end + shift }); found) {
+            slot = std::move(*found);
+            moved.emplace_back(found, &slot);
+            reused++;
+
+            Statistics::count(Counter::subtrees_reused);
+
+            return true;
+        }
+    }
+    else if (unchanged_prefix <= begin && end <= changed_end) {
+        // 編集された範囲にのみある部分式の場合は、再利用できるノードがないため、通常の方法で分割する
+        slot = std::unique_ptr<Node>(new Node());
+
+        Statistics::count(Counter::nodes_created);
+
+        return slot->parse_subexpression(expression, failure);
+    }
+
+    // それ以外の場合は、Node::parse_subexpressionと同様にこの部分式のみを分割し、左右の部分式について再帰的に呼び出す
+    slot = std::unique_ptr<Node>(new Node());
+
+    Statistics::count(Counter::nodes_created);
+
+    std::string::size_type pos_operator;
+
+    if (!Node::split_subexpression(expression, pos_operator, failure))
+        return false;
+
+    if (std::string::npos == pos_operator) {
+        slot->expression = std::string(expression);
+
+        Statistics::count(Counter::bytes_copied, expression.length());
+
+        return true;
+    }
+
+    if (!build(slot->left, expression.substr(0, pos_operator), failure))
+        return false;
+
+    if (!build(slot->right, expression.substr(pos_operator + 1), failure))
+        return false;
+
+    slot->expression = std::string(expression.substr(pos_operator, 1));
+
+    Statistics::count(Counter::bytes_copied);
+
+    return true;
+}
+
+std::unique_ptr<Node>* IncrementalParser::find(Span span)
+{
+    auto slot = &tree;
+    auto current = Span { 0, tree_source.length() };
+
+    // 根ノードから、範囲spanを含む部分式のノードをたどる
+    // (各ノードの部分式の範囲は、分割した際と同じ方法で分割元の式から求める)
+    while (*slot) {
+        if (current.begin == span.begin && current.end == span.end)
+            return slot;
+
+        auto node = slot->get();
+        auto it = splits.find(node);
+
+        if (splits.end() == it) {
+            // (前回分割できた式の部分式であるため、分割に失敗することはない)
+            auto expression = std::string_view(tree_source).substr(current.begin, current.end - current.begin);
+            auto pos_operator = std::string::npos;
+            Node::ParseFailure failure;
+
+            Node::split_subexpression(expression, pos_operator, failure);
+
+            auto inner_begin = static_cast<std::size_t>(expression.data() - tree_source.data());
+
+            it = splits.emplace(node, Split {
+                Span { inner_begin, inner_begin + expression.length() },
+                pos_operator,
+            }).first;
+        }
+
+        auto& split = it->second;
+
+        if (std::string::npos == split.pos_operator)
+            // 項のノードには、これより短い部分式のノードはない
+            return nullptr;
+
+        auto pos_operator = split.inner.begin + split.pos_operator;
+
+        if (span.end <= pos_operator && split.inner.begin <= span.begin) {
+            slot = &node->left;
+            current = Span { split.inner.begin, pos_operator };
+        }
+        else if (pos_operator < span.begin && span.end <= split.inner.end) {
+            slot = &node->right;
+            current = Span { pos_operator + 1, split.inner.end };
+        }
+        else {
+            // 演算子や最も外側の丸括弧をまたぐ範囲の部分式のノードはない
+            return nullptr;
+        }
+    }
+
+    // 既に再利用したノードの部分木の中にはない
+    return nullptr;
+}
+
+} // namespace polish
@@ -0,0 +1,96 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// 編集中の式を、編集のたびに差分のみ二分木へと分割し直すためのヘッダ
+//
+// 部分式を分割した結果はその部分式の文字列のみで決まるため、編集されていない範囲にある部分式は、
+// 編集前の二分木に同じ範囲の部分式のノードがあれば、その部分木をそのまま再利用することができる
+// そのため、分割し直すのは編集された範囲を含む部分式(根ノードから編集箇所までの経路)と、編集で挿入された部分のみとなる
+//
+// 編集された範囲は、前回分割できた式と編集後の式とで一致する先頭部分・末尾部分を除いた範囲とする
+// (そのため、編集の途中で不正な式となった場合でも、次に分割できた時点で前回分割できた二分木を再利用する)
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "polish.hpp"
+
+namespace polish {
+
+// 編集中の式と、それを分割した二分木を保持するクラス
+class IncrementalParser {
+public:
+    // 式expressionを二分木へと分割するコンストラクタ(式が不正な形式の場合も例外は送出しない)
+    explicit IncrementalParser(std::string expression = std::string());
+
+    // 式のoffsetバイト目からremoved_lengthバイトを削除してinserted_textを挿入し、二分木へと分割し直すメソッド
+    // 分割できた場合はtrue、式が不正な形式の場合はfalseを返す(offsetとremoved_lengthが式の範囲外の場合はstd::out_of_rangeを送出する)
+    bool edit(std::size_t offset, std::size_t removed_length, std::string_view inserted_text);
+
+    // 式全体をexpressionに置き換えて、二分木へと分割し直すメソッド(戻り値はeditと同じ)
+    // (前回の式と一致する先頭部分・末尾部分は、editで編集した場合と同様に再利用する)
+    bool update(std::string expression);
+
+    // 編集中の式を返すメソッド
+    const std::string& expression() const noexcept { return text; }
+
+    // 分割した二分木の根ノードを返すメソッド(式が不正な形式の場合はnullptrを返す)
+    // 結果はpolish::parseで編集後の式を分割した場合と同じとなる
+    // 二分木は次の編集で再利用するため、変更してはならない(値を計算すると二分木が変更される)
+    Node* root() const noexcept { return parse_error ? nullptr : tree.get(); }
+
+    // 式が不正な形式の場合に、そのエラーを返すメソッド(分割できた場合はnullptrを返す)
+    const ParseError* error() const noexcept { return parse_error ? &*parse_error : nullptr; }
+
+    // 直前の分割で、再利用した部分木の数を返すメソッド
+    std::size_t reused_subtrees() const noexcept { return reused; }
+
+private:
+    // 式中の範囲[begin, end)
+    struct Span {
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    std::string text;                       // 編集中の式
+    std::string source;                     // 編集中の式から空白を除去したもの
+    std::unique_ptr<Node> tree;             // 前回分割できた二分木
+    std::string tree_source;                // 前回分割できた二分木の分割元の式
+    std::optional<ParseError> parse_error;  // 編集中の式が不正な形式の場合のエラー
+    std::size_t reused = 0;
+
+    // 分割し直す際に用いる、編集されていない先頭部分・末尾部分の長さ
+    std::size_t unchanged_prefix = 0;
+    std::size_t unchanged_suffix = 0;
+
+    // 編集前の二分木のノードを分割した際の、最も外側の丸括弧を除いた範囲と演算子の位置
+    // (分割し直す間のみ使用し、同じノードを何度も探索する場合に再び求めずに済むようにする)
+    struct Split {
+        Span inner;
+        std::size_t pos_operator;
+    };
+
+    std::unordered_map<const Node*, Split> splits;
+
+    // 再利用した部分木の、移動元と移動先(分割に失敗した場合は、移動元に戻す)
+    std::vector<std::pair<std::unique_ptr<Node>*, std::unique_ptr<Node>*>> moved;
+
+    // 編集中の式を、前回分割できた二分木を再利用して分割し直すメソッド
+    bool reparse();
+
+    // 編集後の式の部分式expressionを分割してslotに設定するメソッド
+    // 式が不正な形式の場合は、failureに原因を代入してfalseを返す
+    bool build(std::unique_ptr<Node>& slot, std::string_view expression, Node::ParseFailure& failure);
+
+    // 編集前の二分木から、範囲spanの部分式のノードを探して返すメソッド(ない場合はnullptrを返す)
+    std::unique_ptr<Node>* find(Span span);
+};
+
+} // namespace polish
@@ -0,0 +1,316 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+#include "polish_jit.hpp"
+
+#if !defined(__x86_64__) || defined(_WIN32)
+
+namespace polish {
+
+// 機械語への変換をサポートしない環境では、常に変換できないものとして扱う
+// (形状キャッシュは、すべての式を二分木で計算する)
+std::unique_ptr<CompiledExpression> CompiledExpression::compile(const Node&)
+{
+    return nullptr;
+}
+
+CompiledExpression::~CompiledExpression() = default;
+
+bool CompiledExpression::evaluate(const double*, double&) const noexcept
+{
+    return false;
+}
+
+} // namespace polish
+
+#else
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace polish {
+
+namespace {
+
+// 値の計算に割り当てるXMMレジスタの数(xmm0〜xmm13)
+// xmm14は退避した値の読み込みなどに用いる作業用、xmm15は途中の値が有限かどうかの検査に用いる
+constexpr int allocatable_registers = 14;
+constexpr int scratch_register = 14;
+constexpr int check_register = 15;
+
+// 後行順序(帰りがけ順)に並べた、ひな形の項と演算
+struct Term {
+    char operator_char;     // 演算子(項の場合は'\0')
+    std::size_t left;       // 左の部分式の位置
+    std::size_t right;      // 右の部分式の位置
+    std::size_t slot;       // 項の場合は、プレースホルダの出現順
+    int need;               // 退避せずに値を計算するのに必要なレジスタの数(Sethi-Ullman数)
+};
+
+// 機械語を生成するクラス
+// 生成する関数はSystem V AMD64の呼び出し規約に従い、int function(const double* literals, double* result_value)とする
+// (literalsはrdi、result_valueはrsiで渡され、戻り値はeaxで返す)
+class Assembler {
+public:
+    std::vector<std::uint8_t> code;
+
+    // 関数の先頭(検査用のレジスタを0にする)
+    void prologue()
+    {
+        emit({ 0x66, 0x45, 0x0F, 0x57, 0xFF }); // xorpd xmm15, xmm15
+    }
+
+    // 関数の末尾(xmm0の値を結果として格納し、検査用のレジスタがNaNでなければ1、NaNであれば0を返す)
+    void epilogue()
+    {
+        emit({ 0xF2, 0x0F, 0x11, 0x06 });       // movsd [rsi], xmm0
+        emit({ 0x66, 0x45, 0x0F, 0x2E, 0xFF }); // ucomisd xmm15, xmm15
+        emit({ 0x0F, 0x9B, 0xC0 });             // setnp al
+        emit({ 0x0F, 0xB6, 0xC0 });             // movzx eax, al
+        emit({ 0xC3 });                         // ret
+    }
+
+    // slot番目のリテラルをレジスタxmmに読み込む(movsd xmm, [rdi + 8 * slot])
+    void load_literal(int xmm, std::size_t slot)
+    {
+        auto displacement = static_cast<std::uint32_t>(slot * sizeof(double));
+
+        emit({ 0xF2 });
+        emit_rex(xmm, 0);
+        emit({ 0x0F, 0x10, modrm(0b10, xmm, 0b111) });
+        emit({
+            static_cast<std::uint8_t>(displacement),
+            static_cast<std::uint8_t>(displacement >> 8),
+            static_cast<std::uint8_t>(displacement >> 16),
+            static_cast<std::uint8_t>(displacement >> 24),
+        });
+    }
+
+    // 演算子operator_charでdestinationとsourceを演算し、destinationに格納する(addsd/subsd/mulsd/divsd)
+    void arithmetic(char operator_char, int destination, int source)
+    {
+        std::uint8_t opcode;
+
+        switch (operator_char) {
+            case '+': opcode = 0x58; break;
+            case '-': opcode = 0x5C; break;
+            case '*': opcode = 0x59; break;
+            default:  opcode = 0x5E; break; // '/'
+        }
+
+        emit({ 0xF2 });
+        emit_rex(destination, source);
+        emit({ 0x0F, opcode, modrm(0b11, destination, source) });
+    }
+
+    // sourceの値をdestinationに複製する(movapd destination, source)
+    void move(int destination, int source)
+    {
+        emit({ 0x66 });
+        emit_rex(destination, source);
+        emit({ 0x0F, 0x28, modrm(0b11, destination, source) });
+    }
+
+    // レジスタxmmの値をスタックに退避する(sub rsp, 8; movsd [rsp], xmm)
+    void spill(int xmm)
+    {
+        emit({ 0x48, 0x83, 0xEC, 0x08 });
+        emit({ 0xF2 });
+        emit_rex(xmm, 0);
+        emit({ 0x0F, 0x11, modrm(0b00, xmm, 0b100), 0x24 });
+    }
+
+    // スタックに退避した値をレジスタxmmに読み込む(movsd xmm, [rsp]; add rsp, 8)
+    void reload(int xmm)
+    {
+        emit({ 0xF2 });
+        emit_rex(xmm, 0);
+        emit({ 0x0F, 0x10, modrm(0b00, xmm, 0b100), 0x24 });
+        emit({ 0x48, 0x83, 0xC4, 0x08 });
+    }
+
+    // レジスタxmmの値が有限でない場合に、検査用のレジスタがNaNとなるようにする
+    // (有限の値vに対してv - vは0となり、無限大・NaNに対してはNaNとなるため、これを検査用のレジスタに加算する)
+    void check_finite(int xmm)
+    {
+        move(scratch_register, xmm);
+        arithmetic('-', scratch_register, xmm);
+        arithmetic('+', check_register, scratch_register);
+    }
+
+private:
+    void emit(std::initializer_list<std::uint8_t> bytes)
+    {
+        code.insert(code.end(), bytes);
+    }
+
+    // 拡張レジスタ(xmm8〜xmm15)を用いる場合に、REXプレフィックスを出力する
+    void emit_rex(int reg, int rm)
+    {
+        std::uint8_t rex = 0x40 | (8 <= reg ? 0x04 : 0) | (8 <= rm ? 0x01 : 0);
+
+        if (0x40 != rex)
+            emit({ rex });
+    }
+
+    static std::uint8_t modrm(int mod, int reg, int rm)
+    {
+        return static_cast<std::uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+    }
+};
+
+// terms[index]の値をレジスタxmm(xmm以降のレジスタは使用してよい)に計算する命令を生成する
+// 必要なレジスタが多い側の部分式を先に計算することで、使用するレジスタの数を最小にする
+// (割り当てられるレジスタが足りない場合は、先に計算した部分式の値をスタックに退避する)
+void generate(Assembler& assembler, const std::vector<Term>& terms, std::size_t index, int xmm)
+{
+    auto& term = terms[index];
+
+    if ('\0' == term.operator_char) {
+        assembler.load_literal(xmm, term.slot);
+        return;
+    }
+
+    auto& left = terms[term.left];
+    auto& right = terms[term.right];
+    auto spilled = allocatable_registers <= xmm + 1;
+
+    if (right.need <= left.need) {
+        generate(assembler, terms, term.left, xmm);
+
+        if (spilled) {
+            assembler.spill(xmm);
+            generate(assembler, terms, term.right, xmm);
+            assembler.reload(scratch_register);
+            assembler.arithmetic(term.operator_char, scratch_register, xmm);
+            assembler.move(xmm, scratch_register);
+        }
+        else {
+            generate(assembler, terms, term.right, xmm + 1);
+            assembler.arithmetic(term.operator_char, xmm, xmm + 1);
+        }
+    }
+    else {
+        generate(assembler, terms, term.right, xmm);
+
+        if (spilled) {
+            assembler.spill(xmm);
+            generate(assembler, terms, term.left, xmm);
+            assembler.reload(scratch_register);
+            assembler.arithmetic(term.operator_char, xmm, scratch_register);
+        }
+        else {
+            generate(assembler, terms, term.left, xmm + 1);
+            assembler.arithmetic(term.operator_char, xmm + 1, xmm);
+            assembler.move(xmm, xmm + 1);
+        }
+    }
+
+    assembler.check_finite(xmm);
+}
+
+} // namespace
+
+std::unique_ptr<CompiledExpression> CompiledExpression::compile(const Node& root)
+{
+    // ひな形を後行順序に並べ替える(変換できない項・演算子を含む場合はfalseを返す)
+    std::vector<Term> terms;
+    std::size_t literals = 0;
+
+    auto flatten = [&terms, &literals](auto& self, const Node& node) -> bool {
+        if (!node.left || !node.right) {
+            // 項はプレースホルダのみからなるもの(数値のリテラル)のみを扱う
+            if (1 != node.expression.length() || ShapeCache::placeholder != node.expression.front())
+                return false;
+
+            terms.push_back(Term { '\0', 0, 0, literals++, 1 });
+            return true;
+        }
+
+        // 剰余・累乗など、対応する命令がない演算子を含む場合は変換しない(Nodeを用いて計算する)
+        switch (node.expression.front()) {
+            case '+': case '-': case '*': case '/': break;
+            default: return false;
+        }
+
+        if (!self(self, *node.left))
+            return false;
+
+        auto left = terms.size() - 1;
+
+        if (!self(self, *node.right))
+            return false;
+
+        auto right = terms.size() - 1;
+        auto left_need = terms[left].need;
+        auto right_need = terms[right].need;
+
+        terms.push_back(Term {
+            node.expression.front(),
+            left,
+            right,
+            0,
+            left_need == right_need ? left_need + 1 : std::max(left_need, right_need),
+        });
+
+        return true;
+    };
+
+    if (!flatten(flatten, root))
+        return nullptr;
+
+    Assembler assembler;
+
+    assembler.prologue();
+    generate(assembler, terms, terms.size() - 1, 0);
+    assembler.epilogue();
+
+    // 書き込み可能な領域に機械語を書き込んだ後、実行可能な領域に変更する
+    auto page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    auto length = assembler.code.size();
+    auto page_length = (length + page_size - 1) / page_size * page_size;
+    auto page = ::mmap(nullptr, page_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (MAP_FAILED == page)
+        return nullptr;
+
+    std::memcpy(page, assembler.code.data(), length);
+
+    if (0 != ::mprotect(page, page_length, PROT_READ | PROT_EXEC)) {
+        ::munmap(page, page_length);
+        return nullptr;
+    }
+
+    return std::unique_ptr<CompiledExpression>(new CompiledExpression(page, page_length, length, literals));
+}
+
+CompiledExpression::CompiledExpression(void* page, std::size_t page_length, std::size_t length, std::size_t literals) noexcept
+    : page(page), page_length(page_length), length(length), literals(literals)
+{
+}
+
+CompiledExpression::~CompiledExpression()
+{
+    ::munmap(page, page_length);
+}
+
+bool CompiledExpression::evaluate(const double* literals, double& result_value) const noexcept
+{
+    double value;
+
+    if (0 == reinterpret_cast<Function>(page)(literals, &value))
+        return false;
+
+    result_value = value;
+
+    return true;
+}
+
+} // namespace polish
+
+#endif
@@ -0,0 +1,64 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// 形状キャッシュ(ShapeCache)の二分木のひな形を、x86-64のSSE2命令による機械語に変換して実行するためのヘッダ
+//
+// ひな形の各項(プレースホルダ)を引数とし、分岐のない命令列として式全体の値を計算する関数を生成する
+// 生成した関数はmmapで確保した領域に書き込み、実行可能に変更してから呼び出す
+// (x86-64のLinuxなど、POSIXの環境でのみ使用できる、それ以外の環境ではコンパイルできないものとして扱う)
+//
+// 計算結果は、Node::calculate_expression_tree(double&)で計算した場合とビット単位で同じ値となる
+// これは、有限の値に対する演算はどちらも同じIEEE 754の倍精度の演算となり、
+// また途中の値の文字列化・数値化(%.17g)も有限の値に対しては値を変えないためである
+// そのため、途中の値が有限でなくなる場合(無限大・NaN)は計算できなかったものとし、二分木での計算に任せる
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "polish.hpp"
+
+namespace polish {
+
+// 機械語に変換した式
+class CompiledExpression {
+public:
+    // この環境で機械語への変換ができるかどうか
+#if defined(__x86_64__) && !defined(_WIN32)
+    static constexpr bool supported = true;
+#else
+    static constexpr bool supported = false;
+#endif
+
+    // 二分木のひな形rootを機械語に変換するメソッド
+    // ひな形の項がすべてプレースホルダで、演算子がすべて四則演算の場合のみ変換でき、それ以外の場合はnullptrを返す
+    static std::unique_ptr<CompiledExpression> compile(const Node& root);
+
+    ~CompiledExpression();
+
+    CompiledExpression(const CompiledExpression&) = delete;
+    CompiledExpression& operator=(const CompiledExpression&) = delete;
+
+    // ひな形のプレースホルダに、出現順にliteralsの値を当てはめて式全体の値を計算するメソッド
+    // (literalsはliteral_count()個の有限の値である必要がある)
+    // 計算できた場合は計算結果をresult_valueに代入してtrueを返し、途中の値が有限でなくなった場合はfalseを返す
+    bool evaluate(const double* literals, double& result_value) const noexcept;
+
+    // ひな形のプレースホルダの数を返すメソッド
+    std::size_t literal_count() const noexcept { return literals; }
+
+    // 生成した機械語の長さを返すメソッド
+    std::size_t code_length() const noexcept { return length; }
+
+private:
+    using Function = int (*)(const double* literals, double* result_value);
+
+    CompiledExpression(void* page, std::size_t page_length, std::size_t length, std::size_t literals) noexcept;
+
+    void* page;                 // 機械語を書き込んだ、mmapで確保した領域
+    std::size_t page_length;    // 確保した領域の長さ
+    std::size_t length;         // 機械語の長さ
+    std::size_t literals;       // プレースホルダの数
+};
+
+} // namespace polish
@@ -0,0 +1,1239 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// 式をコンパイル時に二分木へと分割し、各記法への変換と計算を行うためのヘッダ
+//
+// 使用例:
+//   using namespace polish::literals;
+//
+//   constexpr auto exp = "(1+2)*3"_polish;
+//
+//   static_assert(exp.reverse_polish_notation() == "1 2 + 3 * ");
+//   static_assert(exp.calculated_result() == 9.0);
+//
+// 不正な式が与えられた場合はコンパイルエラーとなる
+// 変換・計算の結果は、実行時にNodeクラスで分割・計算した場合と同一となる
+// (累乗は、結果がdoubleで正確に表現できる場合のみ計算でき、それ以外の場合はコンパイルエラーとなる)
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "polish_operators.hpp"
+
+namespace polish {
+
+namespace detail {
+
+// 不正な式が与えられたことをコンパイルエラーとして報告するための関数
+// (いずれもconstexpr関数ではないため、コンパイル時の評価中に呼び出されるとコンパイルエラーとなる)
+inline void empty_expression() {}     // 式が空の場合
+inline void unbalanced_bracket() {}   // 括弧の対応が取れていない場合
+inline void empty_bracket() {}        // 空の丸括弧がある場合
+inline void invalid_expression() {}   // 演算子の位置が不正な場合
+inline void number_out_of_range() {}  // 数値がdoubleで表現できる範囲を超える場合
+inline void unsupported_power() {}    // 累乗の結果を、コンパイル時に正確に求められない場合
+inline void unsupported_operator() {} // 計算できる演算子(Operators)のうち、コンパイル時の演算が定義されていないものを含む場合
+
+// コンパイル時に文字列を構築するための型
+// (GCC 12では短い文字列を保持するstd::stringを定数式中で破棄できないため、std::vector<char>を用いる)
+using CharBuffer = std::vector<char>;
+
+constexpr void append(CharBuffer& buffer, std::string_view str) { buffer.insert(buffer.end(), str.begin(), str.end()); }
+constexpr void append(CharBuffer& buffer, char ch) { buffer.push_back(ch); }
+constexpr std::string_view view_of(const CharBuffer& buffer) { return std::string_view(buffer.data(), buffer.size()); }
+
+// コンパイル時に任意精度の非負整数を扱うためのクラス
+// (数値と文字列の相互変換・四則演算を、コンパイラの浮動小数点演算に依存せずに正確に行うために用いる)
+class BigInteger {
+private:
+    std::vector<std::uint32_t> words; // 32ビットごとに区切った値(下位から順に格納し、最上位の要素は常に0以外とする)
+
+public:
+    constexpr BigInteger(std::uint64_t value = 0)
+    {
+        for (; 0 != value; value >>= 32) {
+            words.push_back(static_cast<std::uint32_t>(value));
+        }
+    }
+
+    constexpr bool is_zero() const { return words.empty(); }
+
+    // 値を表すのに必要なビット数を返す
+    constexpr std::size_t bit_length() const
+    {
+        return words.empty() ? 0 : (words.size() - 1) * 32 + std::bit_width(words.back());
+    }
+
+    // 下位64ビットの値を返す
+    constexpr std::uint64_t low_bits() const
+    {
+        std::uint64_t value = 0;
+
+        for (std::size_t i = 0; i < std::min<std::size_t>(2, words.size()); i++) {
+            value |= static_cast<std::uint64_t>(words[i]) << (32 * i);
+        }
+
+        return value;
+    }
+
+    constexpr int compare(const BigInteger& other) const
+    {
+        if (words.size() != other.words.size())
+            return words.size() < other.words.size() ? -1 : 1;
+
+        for (auto i = words.size(); 0 < i--; ) {
+            if (words[i] != other.words[i])
+                return words[i] < other.words[i] ? -1 : 1;
+        }
+
+        return 0;
+    }
+
+    // 値をmultiplier倍し、addendを加算する
+    constexpr void multiply_add(std::uint32_t multiplier, std::uint32_t addend)
+    {
+        std::uint64_t carry = addend;
+
+        for (auto& word : words) {
+            auto value = static_cast<std::uint64_t>(word) * multiplier + carry;
+            word = static_cast<std::uint32_t>(value);
+            carry = value >> 32;
+        }
+
+        if (0 != carry)
+            words.push_back(static_cast<std::uint32_t>(carry));
+
+        normalize();
+    }
+
+    // 値をdivisorで除算し、剰余を返す
+    constexpr std::uint32_t divide(std::uint32_t divisor)
+    {
+        std::uint64_t remainder = 0;
+
+        for (auto i = words.size(); 0 < i--; ) {
+            auto value = (remainder << 32) | words[i];
+            words[i] = static_cast<std::uint32_t>(value / divisor);
+            remainder = value % divisor;
+        }
+
+        normalize();
+
+        return static_cast<std::uint32_t>(remainder);
+    }
+
+    constexpr void multiply(const BigInteger& other)
+    {
+        std::vector<std::uint32_t> product(words.size() + other.words.size(), 0);
+
+        for (std::size_t i = 0; i < words.size(); i++) {
+            std::uint64_t carry = 0;
+
+            for (std::size_t j = 0; j < other.words.size(); j++) {
+                auto value = static_cast<std::uint64_t>(words[i]) * other.words[j] + product[i + j] + carry;
+                product[i + j] = static_cast<std::uint32_t>(value);
+                carry = value >> 32;
+            }
+
+            product[i + other.words.size()] = static_cast<std::uint32_t>(carry);
+        }
+
+        words = std::move(product);
+        normalize();
+    }
+
+    constexpr void add(const BigInteger& other)
+    {
+        words.resize(std::max(words.size(), other.words.size()) + 1, 0);
+
+        std::uint64_t carry = 0;
+
+        for (std::size_t i = 0; i < words.size(); i++) {
+            auto value = carry + words[i] + (i < other.words.size() ? other.words[i] : 0);
+            words[i] = static_cast<std::uint32_t>(value);
+            carry = value >> 32;
+        }
+
+        normalize();
+    }
+
+    // 値からotherを減算する(値がother以上であることを前提とする)
+    constexpr void subtract(const BigInteger& other)
+    {
+        std::int64_t borrow = 0;
+
+        for (std::size_t i = 0; i < words.size(); i++) {
+            auto value = static_cast<std::int64_t>(words[i]) - (i < other.words.size() ? other.words[i] : 0) - borrow;
+            borrow = value < 0 ? 1 : 0;
+            words[i] = static_cast<std::uint32_t>(value + (borrow << 32));
+        }
+
+        normalize();
+    }
+
+    constexpr void shift_left(std::size_t bits)
+    {
+        if (is_zero())
+            return;
+
+        words.insert(words.begin(), bits / 32, 0);
+
+        if (auto shift = bits % 32; 0 != shift) {
+            std::uint32_t carry = 0;
+
+            for (auto i = bits / 32; i < words.size(); i++) {
+                auto word = words[i];
+                words[i] = (word << shift) | carry;
+                carry = word >> (32 - shift);
+            }
+
+            if (0 != carry)
+                words.push_back(carry);
+        }
+    }
+
+    constexpr void shift_right(std::size_t bits)
+    {
+        words.erase(words.begin(), words.begin() + std::min(bits / 32, words.size()));
+
+        if (auto shift = bits % 32; 0 != shift) {
+            for (std::size_t i = 0; i < words.size(); i++) {
+                words[i] = (words[i] >> shift) | (i + 1 < words.size() ? words[i + 1] << (32 - shift) : 0);
+            }
+        }
+
+        normalize();
+    }
+
+    // base^exponentの値を求める
+    static constexpr BigInteger power(std::uint32_t base, std::size_t exponent)
+    {
+        BigInteger value(1);
+
+        for (std::size_t i = 0; i < exponent; i++) {
+            value.multiply_add(base, 0);
+        }
+
+        return value;
+    }
+
+    // 値を10進数表記した数字の並びを返す
+    constexpr std::vector<char> to_decimal_digits() const
+    {
+        std::vector<char> digits;
+
+        for (auto value = *this; !value.is_zero(); ) {
+            auto remainder = value.divide(10);
+            digits.push_back(static_cast<char>('0' + remainder));
+        }
+
+        if (digits.empty())
+            digits.push_back('0');
+
+        std::reverse(digits.begin(), digits.end());
+
+        return digits;
+    }
+
+private:
+    constexpr void normalize()
+    {
+        while (!words.empty() && 0 == words.back()) {
+            words.pop_back();
+        }
+    }
+};
+
+// doubleのビット表現を扱うための定数と関数
+constexpr std::uint64_t sign_bit = std::uint64_t{1} << 63;
+constexpr std::uint64_t exponent_mask = std::uint64_t{0x7FF} << 52;
+constexpr std::uint64_t fraction_mask = (std::uint64_t{1} << 52) - 1;
+
+constexpr std::uint64_t to_bits(double value) { return std::bit_cast<std::uint64_t>(value); }
+constexpr double from_bits(std::uint64_t bits) { return std::bit_cast<double>(bits); }
+constexpr bool is_negative(double value) { return 0 != (to_bits(value) & sign_bit); }
+constexpr bool is_nan(double value) { return (to_bits(value) & ~sign_bit) > exponent_mask; }
+constexpr bool is_infinity(double value) { return (to_bits(value) & ~sign_bit) == exponent_mask; }
+constexpr bool is_zero(double value) { return 0 == (to_bits(value) & ~sign_bit); }
+constexpr double infinity(bool negative) { return from_bits((negative ? sign_bit : 0) | exponent_mask); }
+
+// 無効な演算(0/0や∞-∞など)の結果として生成されるNaNを返す
+// (x86のFPUおよびSSEが生成するNaNは符号ビットが立っているため、実行時の結果と同じ値を返すようにする)
+constexpr double default_nan()
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    return from_bits(sign_bit | exponent_mask | (std::uint64_t{1} << 51));
+#else
+    return from_bits(exponent_mask | (std::uint64_t{1} << 51));
+#endif
+}
+
+// 有限の値valueを、整数mantissaと指数exponentを用いて mantissa×2^exponent の形に分解する
+constexpr void decompose(double value, std::uint64_t& mantissa, int& exponent)
+{
+    auto bits = to_bits(value);
+    auto biased_exponent = static_cast<int>((bits & exponent_mask) >> 52);
+
+    if (0 == biased_exponent) {
+        // 非正規化数の場合
+        mantissa = bits & fraction_mask;
+        exponent = -1074;
+    }
+    else {
+        mantissa = (bits & fraction_mask) | (std::uint64_t{1} << 52);
+        exponent = biased_exponent - 1075;
+    }
+}
+
+// ±(numerator/denominator)×2^exponent の値を、最も近いdoubleの値に丸めて返す(最近接偶数丸め)
+// doubleで表現できる範囲を超える場合は無限大を返す
+constexpr double round_to_double(bool negative, BigInteger numerator, BigInteger denominator, int exponent)
+{
+    if (numerator.is_zero())
+        return negative ? -0.0 : 0.0;
+
+    // 商quotientが2^53以上2^55未満となるように、被除数または除数をシフトする
+    // (このとき値は quotient×2^(exponent-shift) となる)
+    auto shift = 54 - (static_cast<int>(numerator.bit_length()) - static_cast<int>(denominator.bit_length()));
+
+    if (0 <= shift)
+        numerator.shift_left(shift);
+    else
+        denominator.shift_left(-shift);
+
+    // 55ビット分の商を1ビットずつ求める
+    std::uint64_t quotient = 0;
+
+    denominator.shift_left(54);
+
+    for (auto bit = 54; 0 <= bit; bit--) {
+        if (0 <= numerator.compare(denominator)) {
+            numerator.subtract(denominator);
+            quotient |= std::uint64_t{1} << bit;
+        }
+
+        denominator.shift_right(1);
+    }
+
+    auto has_remainder = !numerator.is_zero();
+
+    // 仮数部を53ビットとするために切り捨てるビット数を求める
+    // (結果が非正規化数となる場合は、最下位のビットが2^-1074となるように、さらに多くのビットを切り捨てる)
+    auto drop = static_cast<int>(std::bit_width(quotient)) - 53;
+
+    drop = std::max(drop, -1074 - (exponent - shift));
+
+    std::uint64_t kept = drop < 64 ? quotient >> drop : 0;
+    auto half = drop <= 64 && 0 != ((quotient >> (drop - 1)) & 1);
+    auto lower = has_remainder || (1 < drop && 0 != (quotient & ((std::uint64_t{1} << std::min(drop - 1, 63)) - 1)));
+
+    // 切り捨てる部分がちょうど半分より大きい場合、あるいはちょうど半分で切り捨て後の値が奇数の場合は切り上げる
+    if (half && (lower || 0 != (kept & 1)))
+        kept++;
+
+    auto kept_exponent = exponent - shift + drop;
+
+    if ((std::uint64_t{1} << 53) == kept) {
+        kept >>= 1;
+        kept_exponent++;
+    }
+
+    std::uint64_t bits = negative ? sign_bit : 0;
+
+    if ((std::uint64_t{1} << 52) <= kept) {
+        // 正規化数の場合
+        auto biased_exponent = kept_exponent + 52 + 1023;
+
+        if (2047 <= biased_exponent)
+            return infinity(negative);
+
+        bits |= (static_cast<std::uint64_t>(biased_exponent) << 52) | (kept & fraction_mask);
+    }
+    else {
+        // 非正規化数またはゼロの場合(このときkept_exponentは-1074となる)
+        bits |= kept;
+    }
+
+    return from_bits(bits);
+}
+
+// 加算を行う(IEEE 754の倍精度浮動小数点数の加算と同じ結果を返す)
+constexpr double add(double left, double right)
+{
+    if (is_nan(left))
+        return left;
+    if (is_nan(right))
+        return right;
+
+    if (is_infinity(left))
+        return is_infinity(right) && is_negative(left) != is_negative(right) ? default_nan() : left;
+    if (is_infinity(right))
+        return right;
+
+    std::uint64_t left_mantissa, right_mantissa;
+    int left_exponent, right_exponent;
+
+    decompose(left, left_mantissa, left_exponent);
+    decompose(right, right_mantissa, right_exponent);
+
+    // 指数の小さい方にそろえた上で、仮数部同士を整数として加減算する
+    auto exponent = std::min(left_exponent, right_exponent);
+
+    BigInteger left_value(left_mantissa);
+    BigInteger right_value(right_mantissa);
+
+    left_value.shift_left(left_exponent - exponent);
+    right_value.shift_left(right_exponent - exponent);
+
+    if (is_negative(left) == is_negative(right)) {
+        left_value.add(right_value);
+        return round_to_double(is_negative(left), left_value, 1, exponent);
+    }
+
+    switch (left_value.compare(right_value)) {
+        case 0: return 0.0; // 絶対値が同じで符号が異なる場合は+0とする
+        case 1: left_value.subtract(right_value); return round_to_double(is_negative(left), left_value, 1, exponent);
+        default: right_value.subtract(left_value); return round_to_double(is_negative(right), right_value, 1, exponent);
+    }
+}
+
+// 減算を行う(IEEE 754の倍精度浮動小数点数の減算と同じ結果を返す)
+constexpr double subtract(double left, double right)
+{
+    if (is_nan(right))
+        return is_nan(left) ? left : right;
+
+    return add(left, from_bits(to_bits(right) ^ sign_bit));
+}
+
+// 乗算を行う(IEEE 754の倍精度浮動小数点数の乗算と同じ結果を返す)
+constexpr double multiply(double left, double right)
+{
+    if (is_nan(left))
+        return left;
+    if (is_nan(right))
+        return right;
+
+    auto negative = is_negative(left) != is_negative(right);
+
+    if (is_infinity(left) || is_infinity(right))
+        return is_zero(left) || is_zero(right) ? default_nan() : infinity(negative);
+
+    std::uint64_t left_mantissa, right_mantissa;
+    int left_exponent, right_exponent;
+
+    decompose(left, left_mantissa, left_exponent);
+    decompose(right, right_mantissa, right_exponent);
+
+    BigInteger product(left_mantissa);
+
+    product.multiply(right_mantissa);
+
+    return round_to_double(negative, product, 1, left_exponent + right_exponent);
+}
+
+// 除算を行う(IEEE 754の倍精度浮動小数点数の除算と同じ結果を返す)
+constexpr double divide(double left, double right)
+{
+    if (is_nan(left))
+        return left;
+    if (is_nan(right))
+        return right;
+
+    auto negative = is_negative(left) != is_negative(right);
+
+    if (is_infinity(left))
+        return is_infinity(right) ? default_nan() : infinity(negative);
+    if (is_infinity(right))
+        return negative ? -0.0 : 0.0;
+
+    if (is_zero(right))
+        return is_zero(left) ? default_nan() : infinity(negative);
+
+    std::uint64_t left_mantissa, right_mantissa;
+    int left_exponent, right_exponent;
+
+    decompose(left, left_mantissa, left_exponent);
+    decompose(right, right_mantissa, right_exponent);
+
+    return round_to_double(negative, left_mantissa, right_mantissa, left_exponent - right_exponent);
+}
+
+// 剰余を求める(std::fmodと同じ結果を返す)
+// (剰余はdoubleで正確に表現できるため、丸めは生じない)
+constexpr double remainder(double left, double right)
+{
+    if (is_nan(left))
+        return left;
+    if (is_nan(right))
+        return right;
+
+    if (is_infinity(left) || is_zero(right))
+        return default_nan();
+    if (is_infinity(right) || is_zero(left))
+        return left;
+
+    std::uint64_t left_mantissa, right_mantissa;
+    int left_exponent, right_exponent;
+
+    decompose(left, left_mantissa, left_exponent);
+    decompose(right, right_mantissa, right_exponent);
+
+    // 指数の小さい方にそろえた上で、仮数部同士を整数として剰余を求める
+    auto exponent = std::min(left_exponent, right_exponent);
+
+    BigInteger left_value(left_mantissa);
+    BigInteger right_value(right_mantissa);
+
+    left_value.shift_left(left_exponent - exponent);
+    right_value.shift_left(right_exponent - exponent);
+
+    // 除数を左項と同じ桁までシフトし、1ビットずつ減算する
+    auto bits = static_cast<int>(left_value.bit_length()) - static_cast<int>(right_value.bit_length());
+
+    if (0 <= bits) {
+        right_value.shift_left(bits);
+
+        for (; 0 <= bits; bits--) {
+            if (0 <= left_value.compare(right_value))
+                left_value.subtract(right_value);
+
+            right_value.shift_right(1);
+        }
+    }
+
+    // 結果の符号は左項と同じとする(割り切れた場合も符号付きのゼロとなる)
+    return round_to_double(is_negative(left), left_value, 1, exponent);
+}
+
+// 累乗を行う(std::powと同じ結果を返す)
+// 有限の値の整数乗のうち、結果がdoubleで正確に表現できる場合と、結果が無限大となる場合のみを扱い、それ以外の場合はコンパイルエラーとする
+// (正確に表現できる結果は、実行時のstd::powでも丸めずに求まるため、同じ結果となる)
+constexpr double power(double base, double exponent)
+{
+    // 指数がゼロの場合は、底によらず1となる
+    if (is_zero(exponent))
+        return 1.0;
+
+    if (is_nan(base) || is_nan(exponent) || is_infinity(base) || is_infinity(exponent)) {
+        unsupported_power();
+        return default_nan();
+    }
+
+    std::uint64_t exponent_mantissa;
+    int exponent_exponent;
+
+    decompose(exponent, exponent_mantissa, exponent_exponent);
+
+    // 指数が整数でない場合は扱わない
+    if (exponent_exponent < 0 && (exponent_exponent <= -53 || 0 != (exponent_mantissa & ((std::uint64_t{1} << -exponent_exponent) - 1)))) {
+        unsupported_power();
+        return default_nan();
+    }
+
+    // 指数の絶対値count(2^62以上となる場合は、偶数かつ十分に大きい値としてhuge_countをtrueとする)
+    auto huge_count = 10 < exponent_exponent;
+    auto count = huge_count ? 0 : exponent_exponent < 0 ? exponent_mantissa >> -exponent_exponent : exponent_mantissa << exponent_exponent;
+    auto negative = is_negative(base) && !huge_count && 0 != (count & 1);
+    auto reciprocal = is_negative(exponent);
+
+    // 底がゼロの場合は、指数が負ならば無限大、正ならばゼロとなる
+    if (is_zero(base))
+        return reciprocal ? infinity(negative) : (negative ? -0.0 : 0.0);
+
+    std::uint64_t base_mantissa;
+    int base_exponent;
+
+    decompose(base, base_mantissa, base_exponent);
+
+    // 底を 奇数×2^base_exponent の形にする
+    auto trailing_zeros = std::countr_zero(base_mantissa);
+
+    base_mantissa >>= trailing_zeros;
+    base_exponent += trailing_zeros;
+
+    if (1 == base_mantissa && 0 == base_exponent)
+        // 底が±1の場合
+        return negative ? -1.0 : 1.0;
+
+    // 結果は 底の奇数部分^count × 2^(base_exponent×count) となる
+    // (底が2の累乗でない場合、奇数部分の累乗は指数が負ならば有限の桁数で表せず、正ならばcountとともに桁数が増える)
+    if (1 != base_mantissa && (reciprocal || huge_count)) {
+        unsupported_power();
+        return default_nan();
+    }
+
+    BigInteger odd_power(1);
+
+    for (std::uint64_t i = 0; i < count && 1 != base_mantissa; i++) {
+        odd_power.multiply(base_mantissa);
+
+        if (53 < odd_power.bit_length()) {
+            unsupported_power();
+            return default_nan();
+        }
+    }
+
+    // 2の累乗の部分の指数(範囲外となる場合は、結果の大きさから無限大かどうかのみを判定する)
+    constexpr std::int64_t exponent_limit = 4096;
+
+    auto scale_exponent = huge_count || exponent_limit < count
+        ? ((0 < base_exponent) != reciprocal ? exponent_limit : -exponent_limit)
+        : static_cast<std::int64_t>(base_exponent) * static_cast<std::int64_t>(count) * (reciprocal ? -1 : 1);
+
+    // 結果が2^1024以上となる場合は無限大となる
+    if (1024 < scale_exponent + static_cast<std::int64_t>(odd_power.bit_length()))
+        return infinity(negative);
+
+    // 結果が非正規化数の最小値の単位で表せない場合は、正確に表現できない
+    if (scale_exponent < -1074) {
+        unsupported_power();
+        return default_nan();
+    }
+
+    return round_to_double(negative, odd_power, 1, static_cast<int>(scale_exponent));
+}
+
+// 文字列を数値化した結果
+enum class NumberParseResult {
+    not_a_number, // 数値ではない(記号などを含む)
+    number,       // 数値に変換できた
+    out_of_range, // 数値の形式だが、doubleで表現できる範囲を超えている
+};
+
+constexpr bool equals_ignore_case(std::string_view str, std::string_view lower_case)
+{
+    return str.length() == lower_case.length() &&
+        std::equal(str.begin(), str.end(), lower_case.begin(), [](char c, char l) {
+            return ('A' <= c && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c) == l;
+        });
+}
+
+constexpr bool is_digit(char c) { return '0' <= c && c <= '9'; }
+
+// 与えられた文字列を数値化する
+// (std::from_chars(std::chars_format::general)と同じ形式を受け付け、同じ値に変換する)
+constexpr NumberParseResult parse_number(std::string_view expression, double& number)
+{
+    if (equals_ignore_case(expression, "inf") || equals_ignore_case(expression, "infinity")) {
+        number = infinity(false);
+        return NumberParseResult::number;
+    }
+
+    if (equals_ignore_case(expression, "nan") ||
+        (4 < expression.length() && equals_ignore_case(expression.substr(0, 4), "nan(") && ')' == expression.back() &&
+         std::all_of(expression.begin() + 4, expression.end() - 1, [](char c) {
+             return is_digit(c) || ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || '_' == c;
+         }))) {
+        number = from_bits(exponent_mask | (std::uint64_t{1} << 51));
+        return NumberParseResult::number;
+    }
+
+    BigInteger mantissa;         // 仮数部の各桁を並べた整数
+    long long exponent = 0;      // 10進数での指数
+    std::size_t digits = 0;      // 仮数部の有効桁数(先頭の0を除く)
+    auto has_digits = false;
+    auto it = expression.begin();
+
+    // 整数部
+    for (; it != expression.end() && is_digit(*it); it++) {
+        has_digits = true;
+
+        if (0 < digits || '0' != *it) {
+            mantissa.multiply_add(10, static_cast<std::uint32_t>(*it - '0'));
+            digits++;
+        }
+    }
+
+    // 小数部
+    if (it != expression.end() && '.' == *it) {
+        for (it++; it != expression.end() && is_digit(*it); it++) {
+            has_digits = true;
+            exponent--;
+
+            if (0 < digits || '0' != *it) {
+                mantissa.multiply_add(10, static_cast<std::uint32_t>(*it - '0'));
+                digits++;
+            }
+        }
+    }
+
+    if (!has_digits)
+        return NumberParseResult::not_a_number;
+
+    // 指数部(指数部の形式が不正な場合、from_charsはその直前までを数値として扱うため、文字列全体としては数値とならない)
+    if (it != expression.end() && ('e' == *it || 'E' == *it)) {
+        it++;
+
+        auto exponent_negative = false;
+
+        if (it != expression.end() && ('+' == *it || '-' == *it))
+            exponent_negative = '-' == *it++;
+
+        if (it == expression.end() || !is_digit(*it))
+            return NumberParseResult::not_a_number;
+
+        long long explicit_exponent = 0;
+
+        for (; it != expression.end() && is_digit(*it); it++) {
+            explicit_exponent = std::min(explicit_exponent * 10 + (*it - '0'), 100000LL);
+        }
+
+        exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+    }
+
+    if (it != expression.end())
+        return NumberParseResult::not_a_number;
+
+    if (mantissa.is_zero()) {
+        number = 0.0;
+        return NumberParseResult::number;
+    }
+
+    // 値の桁数から、明らかにdoubleで表現できる範囲を超えるものを除外する
+    auto magnitude = static_cast<long long>(digits) + exponent; // 値は10^(magnitude-1)以上10^magnitude未満となる
+
+    if (310 < magnitude || magnitude < -325)
+        return NumberParseResult::out_of_range;
+
+    if (0 <= exponent) {
+        mantissa.multiply(BigInteger::power(10, static_cast<std::size_t>(exponent)));
+        number = round_to_double(false, mantissa, 1, 0);
+    }
+    else {
+        number = round_to_double(false, mantissa, BigInteger::power(10, static_cast<std::size_t>(-exponent)), 0);
+    }
+
+    return is_infinity(number) || is_zero(number) ? NumberParseResult::out_of_range : NumberParseResult::number;
+}
+
+// 演算結果の数値を文字列化してoutputに追記する(printfの書式"%.17g"と同じ形式に変換する)
+constexpr void format_number(double number, CharBuffer& output)
+{
+    if (is_negative(number))
+        append(output, '-');
+
+    if (is_nan(number))
+        return append(output, "nan");
+    if (is_infinity(number))
+        return append(output, "inf");
+    if (is_zero(number))
+        return append(output, "0");
+
+    constexpr int precision = 17;
+
+    // 値を正確に10進数表記した場合の数字の並びdigitsと、小数点以下の桁数scaleを求める
+    std::uint64_t mantissa;
+    int exponent;
+
+    decompose(number, mantissa, exponent);
+
+    BigInteger value(mantissa);
+    auto scale = 0;
+
+    if (0 <= exponent) {
+        value.shift_left(exponent);
+    }
+    else {
+        // mantissa×2^-n = mantissa×5^n×10^-n
+        value.multiply(BigInteger::power(5, -exponent));
+        scale = -exponent;
+    }
+
+    auto digits = value.to_decimal_digits();
+    auto decimal_exponent = static_cast<int>(digits.size()) - 1 - scale; // 先頭の桁の指数
+
+    // 有効桁数precisionに丸める(最近接偶数丸め)
+    if (precision < static_cast<int>(digits.size())) {
+        auto round_digit = digits[precision];
+        auto has_lower = std::any_of(digits.begin() + precision + 1, digits.end(), [](char c) { return '0' != c; });
+
+        digits.resize(precision);
+
+        if ('5' < round_digit || ('5' == round_digit && (has_lower || 0 != ((digits.back() - '0') & 1)))) {
+            auto pos = digits.size();
+
+            for (; 0 < pos && '9' == digits[pos - 1]; pos--) {
+                digits[pos - 1] = '0';
+            }
+
+            if (0 == pos) {
+                digits.insert(digits.begin(), '1');
+                digits.pop_back();
+                decimal_exponent++;
+            }
+            else {
+                digits[pos - 1]++;
+            }
+        }
+    }
+
+    // %gと同様に、指数に応じて固定小数点形式または指数形式を選択し、小数部末尾の0を取り除く
+    auto scientific = decimal_exponent < -4 || precision <= decimal_exponent;
+    auto integral_digits = scientific ? 1 : std::max(decimal_exponent + 1, 1);
+
+    while (integral_digits < static_cast<int>(digits.size()) && '0' == digits.back()) {
+        digits.pop_back();
+    }
+
+    auto digits_view = view_of(digits);
+
+    if (scientific) {
+        // 指数形式で表記する
+        append(output, digits_view.front());
+
+        if (1 < digits_view.length()) {
+            append(output, '.');
+            append(output, digits_view.substr(1));
+        }
+
+        auto exponent_digits = BigInteger(static_cast<std::uint64_t>(decimal_exponent < 0 ? -decimal_exponent : decimal_exponent)).to_decimal_digits();
+
+        append(output, decimal_exponent < 0 ? "e-" : "e+");
+
+        if (exponent_digits.size() < 2)
+            append(output, '0');
+
+        append(output, view_of(exponent_digits));
+    }
+    else if (decimal_exponent < 0) {
+        // 固定小数点形式で、1未満の値を表記する
+        append(output, "0.");
+        output.insert(output.end(), -decimal_exponent - 1, '0');
+        append(output, digits_view);
+    }
+    else {
+        // 固定小数点形式で、1以上の値を表記する
+        append(output, digits_view.substr(0, std::min<std::size_t>(decimal_exponent + 1, digits_view.length())));
+        output.insert(output.end(), std::max<std::size_t>(decimal_exponent + 1, digits_view.length()) - digits_view.length(), '0');
+
+        if (static_cast<std::size_t>(decimal_exponent + 1) < digits_view.length()) {
+            append(output, '.');
+            append(output, digits_view.substr(decimal_exponent + 1));
+        }
+    }
+}
+
+} // namespace detail
+
+// コンパイル時に分割した二分木のノード
+struct ConstantNode {
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    std::size_t offset = 0;     // このノードが表す演算子または項の、式中での位置
+    std::size_t length = 0;     // このノードが表す演算子または項の長さ
+    std::size_t left = npos;    // 左の子ノードのインデックス(子ノードを持たない場合はnpos)
+    std::size_t right = npos;   // 右の子ノードのインデックス(子ノードを持たない場合はnpos)
+};
+
+namespace detail {
+
+// 式をコンパイル時に二分木へと分割し、各記法への変換と計算を行うクラス
+// (Nodeクラスの各メソッドと同じ手順で処理を行う)
+class ConstantExpressionBuilder {
+public:
+    CharBuffer expression;                      // 空白を除去した式
+    std::vector<ConstantNode> nodes;            // 後行順序(帰りがけ順)に並べた二分木のノード
+    CharBuffer postorder, inorder, preorder;    // 各記法に変換した式
+    CharBuffer calculated_expression;           // 計算結果の値、または計算結果の式
+    bool calculable = false;                    // 式全体の値を計算できたかどうか
+    double calculated_result = 0.0;             // 式全体の値
+
+    constexpr ConstantExpressionBuilder(std::string_view source)
+    {
+        // 式から空白を除去する
+        std::copy_if(source.begin(), source.end(), std::back_inserter(expression), [](char ch) { return ' ' != ch; });
+
+        if (expression.empty())
+            empty_expression();
+
+        auto root = parse_expression(0, expression.size());
+
+        write_postorder(root);
+        write_inorder(root);
+        write_preorder(root);
+
+        // 二分木から式全体の値を計算する
+        std::vector<double> values(nodes.size(), 0.0);
+        std::vector<bool> calculated(nodes.size(), false);
+
+        calculate_node(root, values, calculated);
+
+        if (!calculated[root]) {
+            // 根ノードが項の場合は、その項を数値化する
+            switch (parse_number(text_of(nodes[root]), values[root])) {
+                case NumberParseResult::out_of_range: number_out_of_range(); break;
+                case NumberParseResult::number: calculated[root] = true; break;
+                default: break;
+            }
+        }
+
+        if (calculated[root]) {
+            calculable = true;
+            calculated_result = values[root];
+            format_number(calculated_result, calculated_expression);
+        }
+        else {
+            write_calculated_inorder(root, values, calculated);
+        }
+    }
+
+private:
+    constexpr std::string_view text_of(const ConstantNode& node) const
+    {
+        return view_of(expression).substr(node.offset, node.length);
+    }
+
+    // Node::validate_bracket_balanceに相当する処理
+    constexpr void validate_bracket_balance(std::size_t begin, std::size_t end) const
+    {
+        auto nest_depth = 0;
+
+        for (auto i = begin; i < end; i++) {
+            if ('(' == expression[i]) {
+                nest_depth++;
+            }
+            else if (')' == expression[i]) {
+                if (--nest_depth < 0)
+                    break;
+            }
+        }
+
+        if (0 != nest_depth)
+            unbalanced_bracket();
+    }
+
+    // Node::remove_outermost_bracketに相当する処理
+    // (範囲[begin, end)から最も外側にある丸括弧を取り除いた範囲を返す)
+    constexpr void remove_outermost_bracket(std::size_t& begin, std::size_t& end) const
+    {
+        auto has_outermost_bracket = false;
+        auto nest_depth = 0;
+
+        if ('(' == expression[begin]) {
+            has_outermost_bracket = true;
+            nest_depth = 1;
+        }
+
+        for (auto i = begin + 1; i < end; i++) {
+            if ('(' == expression[i]) {
+                nest_depth++;
+            }
+            else if (')' == expression[i]) {
+                nest_depth--;
+
+                if (0 == nest_depth && i + 1 != end) {
+                    has_outermost_bracket = false;
+                    break;
+                }
+            }
+        }
+
+        if (!has_outermost_bracket)
+            return;
+
+        if (end - begin <= 2)
+            empty_bracket();
+
+        begin++;
+        end--;
+
+        if ('(' == expression[begin] && ')' == expression[end - 1])
+            remove_outermost_bracket(begin, end);
+    }
+
+    // Node::get_operator_positionに相当する処理
+    // (実行時と同じく、演算子の分類表と分割位置の決定規則はOperatorsから生成したものを用いる)
+    constexpr std::size_t get_operator_position(std::size_t begin, std::size_t end) const
+    {
+        auto pos_operator = ConstantNode::npos;
+        auto split_threshold = Operators::no_operator;
+        auto nest_depth = 0;
+
+        for (auto i = begin; i < end; i++) {
+            auto rank = Operators::classify(expression[i]);
+
+            if (Operators::other == rank)
+                continue;
+
+            if (Operators::open_bracket == rank) {
+                nest_depth++;
+                continue;
+            }
+
+            if (Operators::close_bracket == rank) {
+                nest_depth--;
+                continue;
+            }
+
+            if (0 == nest_depth && Operators::splits_at(rank, split_threshold)) {
+                split_threshold = Operators::update_split_threshold(rank);
+                pos_operator = i;
+            }
+        }
+
+        return pos_operator;
+    }
+
+    // Node::parse_expressionに相当する処理
+    // (範囲[begin, end)の式を二分木へと分割し、その根となるノードのインデックスを返す)
+    constexpr std::size_t parse_expression(std::size_t begin, std::size_t end)
+    {
+        validate_bracket_balance(begin, end);
+        remove_outermost_bracket(begin, end);
+
+        auto pos_operator = get_operator_position(begin, end);
+
+        if (ConstantNode::npos == pos_operator) {
+            nodes.push_back(ConstantNode { begin, end - begin });
+            return nodes.size() - 1;
+        }
+
+        if (begin == pos_operator || end - 1 == pos_operator)
+            invalid_expression();
+
+        auto left = parse_expression(begin, pos_operator);
+        auto right = parse_expression(pos_operator + 1, end);
+
+        nodes.push_back(ConstantNode { pos_operator, 1, left, right });
+
+        return nodes.size() - 1;
+    }
+
+    constexpr void write_postorder(std::size_t index)
+    {
+        if (ConstantNode::npos != nodes[index].left)
+            write_postorder(nodes[index].left);
+        if (ConstantNode::npos != nodes[index].right)
+            write_postorder(nodes[index].right);
+
+        append(postorder, text_of(nodes[index]));
+        append(postorder, ' ');
+    }
+
+    constexpr void write_preorder(std::size_t index)
+    {
+        append(preorder, text_of(nodes[index]));
+        append(preorder, ' ');
+
+        if (ConstantNode::npos != nodes[index].left)
+            write_preorder(nodes[index].left);
+        if (ConstantNode::npos != nodes[index].right)
+            write_preorder(nodes[index].right);
+    }
+
+    constexpr void write_inorder(std::size_t index)
+    {
+        auto& node = nodes[index];
+        auto has_children = ConstantNode::npos != node.left;
+
+        if (has_children) {
+            append(inorder, '(');
+            write_inorder(node.left);
+            append(inorder, ' ');
+        }
+
+        append(inorder, text_of(node));
+
+        if (has_children) {
+            append(inorder, ' ');
+            write_inorder(node.right);
+            append(inorder, ')');
+        }
+    }
+
+    // 計算済みの部分式をその値で置き換えて、計算結果の式を中置記法で出力する
+    constexpr void write_calculated_inorder(std::size_t index, const std::vector<double>& values, const std::vector<bool>& calculated)
+    {
+        auto& node = nodes[index];
+
+        if (ConstantNode::npos == node.left) {
+            append(calculated_expression, text_of(node));
+        }
+        else if (calculated[index]) {
+            format_number(values[index], calculated_expression);
+        }
+        else {
+            append(calculated_expression, '(');
+            write_calculated_inorder(node.left, values, calculated);
+            append(calculated_expression, ' ');
+            append(calculated_expression, text_of(node));
+            append(calculated_expression, ' ');
+            write_calculated_inorder(node.right, values, calculated);
+            append(calculated_expression, ')');
+        }
+    }
+
+    // Node::calculate_nodeに相当する処理
+    // (帰りがけ順に各ノードの値を計算し、計算できたノードについてcalculatedをtrueとする)
+    constexpr void calculate_node(std::size_t index, std::vector<double>& values, std::vector<bool>& calculated)
+    {
+        auto& node = nodes[index];
+
+        if (ConstantNode::npos == node.left)
+            return;
+
+        calculate_node(node.left, values, calculated);
+        calculate_node(node.right, values, calculated);
+
+        // 左右の子ノードの値を取得する(計算済みでない子ノードは、その項を数値化する)
+        auto number_of = [&](std::size_t child) {
+            if (calculated[child])
+                return NumberParseResult::number;
+
+            return parse_number(text_of(nodes[child]), values[child]);
+        };
+
+        auto left_result = number_of(node.left);
+
+        if (NumberParseResult::not_a_number == left_result)
+            return;
+
+        auto right_result = number_of(node.right);
+
+        if (NumberParseResult::not_a_number == right_result)
+            return;
+
+        auto left_operand = values[node.left];
+        auto right_operand = values[node.right];
+        auto op = expression[node.offset];
+
+        if (!Operators::is_evaluable<double>(op))
+            return;
+
+        if (NumberParseResult::out_of_range == left_result || NumberParseResult::out_of_range == right_result)
+            number_out_of_range();
+
+        // 実行時の演算(OperatorTraits::evaluate)と同じ結果を、コンパイラの浮動小数点演算に依存せずに求める
+        switch (op) {
+            case '+': values[index] = add(left_operand, right_operand); break;
+            case '-': values[index] = subtract(left_operand, right_operand); break;
+            case '*': values[index] = multiply(left_operand, right_operand); break;
+            case '/': values[index] = divide(left_operand, right_operand); break;
+            case '%': values[index] = remainder(left_operand, right_operand); break;
+            case '^': values[index] = power(left_operand, right_operand); break;
+            // Operatorsに追加された演算子で、上記に演算を追加していない場合は、誤った値を返さずにコンパイルエラーとする
+            default: unsupported_operator(); return;
+        }
+
+        calculated[index] = true;
+    }
+
+public:
+    // 各文字列・配列の長さ
+    struct Extents {
+        std::size_t expression, nodes, postorder, inorder, preorder, calculated_expression;
+    };
+
+    constexpr Extents extents() const
+    {
+        return Extents {
+            expression.size(),
+            nodes.size(),
+            postorder.size(),
+            inorder.size(),
+            preorder.size(),
+            calculated_expression.size(),
+        };
+    }
+};
+
+// 文字列リテラルをテンプレート引数として受け取るための型
+template <std::size_t N>
+struct FixedString {
+    char chars[N] {};
+
+    consteval FixedString(const char (&str)[N]) { std::copy_n(str, N, chars); }
+
+    constexpr std::string_view view() const { return std::string_view(chars, N - 1); }
+};
+
+} // namespace detail
+
+// コンパイル時に二分木へと分割・計算した式
+// (各記法への変換結果と計算結果を、実行時の処理を必要としない定数として保持する)
+template <detail::ConstantExpressionBuilder::Extents Extents>
+class ConstantExpression {
+private:
+    std::array<char, Extents.expression> expression_chars {};
+    std::array<ConstantNode, Extents.nodes> node_array {};
+    std::array<char, Extents.postorder> postorder_chars {};
+    std::array<char, Extents.inorder> inorder_chars {};
+    std::array<char, Extents.preorder> preorder_chars {};
+    std::array<char, Extents.calculated_expression> calculated_expression_chars {};
+    bool calculable = false;
+    double result = 0.0;
+
+public:
+    consteval ConstantExpression(const detail::ConstantExpressionBuilder& builder)
+        : calculable(builder.calculable), result(builder.calculated_result)
+    {
+        std::copy(builder.expression.begin(), builder.expression.end(), expression_chars.begin());
+        std::copy(builder.nodes.begin(), builder.nodes.end(), node_array.begin());
+        std::copy(builder.postorder.begin(), builder.postorder.end(), postorder_chars.begin());
+        std::copy(builder.inorder.begin(), builder.inorder.end(), inorder_chars.begin());
+        std::copy(builder.preorder.begin(), builder.preorder.end(), preorder_chars.begin());
+        std::copy(builder.calculated_expression.begin(), builder.calculated_expression.end(), calculated_expression_chars.begin());
+    }
+
+    // 空白を除去した式
+    constexpr std::string_view expression() const { return view_of(expression_chars); }
+
+    // 後行順序(帰りがけ順)に並べた二分木のノード(最後の要素が根ノードとなる)
+    constexpr const std::array<ConstantNode, Extents.nodes>& nodes() const { return node_array; }
+
+    // ノードが表す演算子または項
+    constexpr std::string_view expression_of(const ConstantNode& node) const { return expression().substr(node.offset, node.length); }
+
+    // 逆ポーランド記法(後置記法)に変換した式
+    constexpr std::string_view reverse_polish_notation() const { return view_of(postorder_chars); }
+
+    // 中置記法に変換した式
+    constexpr std::string_view infix_notation() const { return view_of(inorder_chars); }
+
+    // ポーランド記法(前置記法)に変換した式
+    constexpr std::string_view polish_notation() const { return view_of(preorder_chars); }
+
+    // 式全体の値が計算できたかどうか
+    constexpr bool is_calculable() const { return calculable; }
+
+    // 式全体の値(is_calculable()がtrueの場合のみ有効)
+    constexpr double calculated_result() const { return result; }
+
+    // 計算結果を表す文字列
+    // (式全体の値が計算できた場合はその値を文字列化したもの、そうでない場合は計算結果の式を中置記法で表したもの)
+    constexpr std::string_view calculated_expression() const { return view_of(calculated_expression_chars); }
+
+private:
+    template <std::size_t N>
+    static constexpr std::string_view view_of(const std::array<char, N>& chars) { return std::string_view(chars.data(), N); }
+};
+
+// 文字列リテラルで与えられた式を、コンパイル時に二分木へと分割・計算する
+template <detail::FixedString Source>
+consteval auto parse_constant_expression()
+{
+    constexpr auto extents = detail::ConstantExpressionBuilder(Source.view()).extents();
+
+    return ConstantExpression<extents>(detail::ConstantExpressionBuilder(Source.view()));
+}
+
+inline namespace literals {
+
+// 式をコンパイル時に二分木へと分割・計算するユーザー定義リテラル
+// (例: "(1+2)*3"_polish)
+template <detail::FixedString Source>
+consteval auto operator""_polish()
+{
+    return parse_constant_expression<Source>();
+}
+
+} // namespace literals
+
+} // namespace polish
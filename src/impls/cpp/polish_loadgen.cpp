@@ -0,0 +1,171 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// サーバーモードで動作するpolishに要求を送り続け、スループットと応答時間を計測する負荷生成クライアント
+//
+// 使用方法:
+//   polish-loadgen <socket> [-c <connections>] [-n <requests>] [expression...]
+//     -c: 同時に接続する数(接続ごとに1つのスレッドで、応答を受け取るたびに次の要求を送る)
+//     -n: 接続ごとに送る要求の数
+//     expression: 送る式(複数指定した場合は順に送る、省略した場合は既定の式を送る)
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "polish_server.hpp"
+
+// 1つの接続で要求を送り、各要求の応答時間(マイクロ秒)をlatenciesに追加する関数
+// 接続や送受信に失敗した場合、または不正な応答を受け取った場合はfalseを返す
+bool run_client(
+    const std::string& socket_path,
+    const std::vector<std::string>& expressions,
+    std::size_t request_count,
+    std::vector<long long>& latencies
+)
+{
+    sockaddr_un address {};
+
+    address.sun_family = AF_UNIX;
+    std::copy_n(socket_path.begin(), std::min(socket_path.length(), sizeof(address.sun_path) - 1), address.sun_path);
+
+    auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd < 0 || 0 != ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address))) {
+        std::cerr << "cannot connect to " << socket_path << ": " << std::strerror(errno) << std::endl;
+
+        if (0 <= fd)
+            ::close(fd);
+
+        return false;
+    }
+
+    // 指定された長さを読み込むまで読み込みを繰り返す
+    auto read_exactly = [fd](char* buffer, std::size_t length) {
+        for (std::size_t position = 0; position < length; ) {
+            auto read_length = ::read(fd, buffer + position, length - position);
+
+            if (read_length <= 0)
+                return false;
+
+            position += read_length;
+        }
+
+        return true;
+    };
+
+    auto succeeded = true;
+    std::string response;
+
+    for (std::size_t i = 0; i < request_count && succeeded; i++) {
+        auto request = encode_frame(expressions[i % expressions.size()]);
+        auto sent_at = std::chrono::steady_clock::now();
+
+        if (static_cast<ssize_t>(request.length()) != ::send(fd, request.data(), request.length(), MSG_NOSIGNAL)) {
+            succeeded = false;
+            break;
+        }
+
+        char header[frame_header_length];
+
+        if (!read_exactly(header, sizeof(header))) {
+            succeeded = false;
+            break;
+        }
+
+        response.resize(decode_frame_length(header));
+
+        if (!read_exactly(response.data(), response.length()) || !response.starts_with("status: ")) {
+            succeeded = false;
+            break;
+        }
+
+        latencies.push_back(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sent_at).count()
+        );
+    }
+
+    if (!succeeded)
+        std::cerr << "request failed" << std::endl;
+
+    ::close(fd);
+
+    return succeeded;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string socket_path;
+    std::size_t connection_count = 1;
+    std::size_t request_count = 10000;
+    std::vector<std::string> expressions;
+
+    for (auto i = 1; i < argc; i++) {
+        auto arg = std::string_view(argv[i]);
+
+        if ("-c" == arg && i + 1 < argc)
+            connection_count = std::max<std::size_t>(1, std::stoul(argv[++i]));
+        else if ("-n" == arg && i + 1 < argc)
+            request_count = std::stoul(argv[++i]);
+        else if (socket_path.empty())
+            socket_path = arg;
+        else
+            expressions.emplace_back(arg);
+    }
+
+    if (socket_path.empty()) {
+        std::cerr << "usage: polish-loadgen <socket> [-c <connections>] [-n <requests>] [expression...]" << std::endl;
+        return 1;
+    }
+
+    if (expressions.empty())
+        expressions = { "2 + 5 * 3 - 4", "x = 1 + 2", "(1 + 2) * (3 + 4) / 5", "a * (b + c) - 1.5e3" };
+
+    std::vector<std::vector<long long>> latencies_per_connection(connection_count);
+    std::vector<char> results(connection_count, 0);
+    std::vector<std::thread> clients;
+
+    auto started_at = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < connection_count; i++) {
+        clients.emplace_back([&, i]() {
+            results[i] = run_client(socket_path, expressions, request_count, latencies_per_connection[i]);
+        });
+    }
+
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started_at).count();
+
+    // 全接続の応答時間をまとめて、パーセンタイルを求める
+    std::vector<long long> latencies;
+
+    for (auto& l : latencies_per_connection) {
+        latencies.insert(latencies.end(), l.begin(), l.end());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    auto percentile = [&latencies](double ratio) {
+        return latencies.empty() ? 0 : latencies[static_cast<std::size_t>(ratio * (latencies.size() - 1))];
+    };
+
+    std::cout << "requests: " << latencies.size() << std::endl;
+    std::cout << "elapsed: " << elapsed / 1000 << " ms" << std::endl;
+    std::cout << "throughput: " << (0 < elapsed ? latencies.size() * 1000000 / elapsed : 0) << " requests/s" << std::endl;
+    std::cout << "latency p50: " << percentile(0.50) << " us" << std::endl;
+    std::cout << "latency p99: " << percentile(0.99) << " us" << std::endl;
+    std::cout << "latency max: " << (latencies.empty() ? 0 : latencies.back()) << " us" << std::endl;
+
+    return std::all_of(results.begin(), results.end(), [](char result) { return result; }) ? 0 : 1;
+}
@@ -0,0 +1,335 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// 式で使用できる演算子を定義するヘッダ
+//
+// 演算子の記号・優先順位・結合性・演算の内容は、演算子ごとの特性OperatorTraitsにまとめて定義し、
+// 分割時に用いる文字の分類表と演算子の位置の決定規則、計算時の演算は、いずれもOperatorsからコンパイル時に生成する
+// そのため演算子を追加する場合は、OperatorTraitsの特殊化を定義してOperatorsに記号を加えるのみでよい
+// (演算子の数によらず、分割時に1文字ごとに行う処理は分類表の参照1回のみとなり、実行時に演算子の一覧を探索することはない)
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+namespace polish {
+
+// 演算子の結合性(同じ優先順位の演算子が並ぶ場合に、どちら側から先に結合するか)
+enum class Associativity {
+    left,   // 左結合("1-2-3"は"(1-2)-3"となる)
+    right,  // 右結合("2^3^2"は"2^(3^2)"となる)
+};
+
+// 演算子の特性
+// 特殊化は次のメンバを持つ
+//   symbol           : 演算子の記号
+//   precedence       : 優先順位(1以上で、値が低いほど優先順位が低い)
+//   associativity    : 結合性
+//   evaluate         : 浮動小数点数の左右の項を演算する(値を計算しない演算子の場合は定義しない)
+//   evaluate_integer : limitの範囲内の整数の左右の項を整数のまま演算する
+//                      (浮動小数点数で演算した場合と結果が異なりうる場合はfalseを返す、定義しない場合は整数では演算しない)
+//                      結果がlimitの範囲内かどうかは呼び出し側で検証する
+template <char Symbol>
+struct OperatorTraits;
+
+// 代入(値は計算しない)
+template <>
+struct OperatorTraits<'='> {
+    static constexpr char symbol = '=';
+    static constexpr int precedence = 1;
+    static constexpr Associativity associativity = Associativity::left;
+};
+
+// 加算
+template <>
+struct OperatorTraits<'+'> {
+    static constexpr char symbol = '+';
+    static constexpr int precedence = 2;
+    static constexpr Associativity associativity = Associativity::left;
+
+    template <std::floating_point T>
+    static T evaluate(T left_operand, T right_operand) noexcept { return left_operand + right_operand; }
+
+    // 左右の項はlimit(2^53以下)の範囲内のため、オーバーフローしない
+    static constexpr bool evaluate_integer(std::int64_t left_operand, std::int64_t right_operand, std::int64_t, std::int64_t& result) noexcept
+    {
+        result = left_operand + right_operand;
+        return true;
+    }
+};
+
+// 減算
+template <>
+struct OperatorTraits<'-'> {
+    static constexpr char symbol = '-';
+    static constexpr int precedence = 2;
+    static constexpr Associativity associativity = Associativity::left;
+
+    template <std::floating_point T>
+    static T evaluate(T left_operand, T right_operand) noexcept { return left_operand - right_operand; }
+
+    // 左右の項はlimit(2^53以下)の範囲内のため、オーバーフローしない
+    static constexpr bool evaluate_integer(std::int64_t left_operand, std::int64_t right_operand, std::int64_t, std::int64_t& result) noexcept
+    {
+        result = left_operand - right_operand;
+        return true;
+    }
+};
+
+// 乗算
+template <>
+struct OperatorTraits<'*'> {
+    static constexpr char symbol = '*';
+    static constexpr int precedence = 3;
+    static constexpr Associativity associativity = Associativity::left;
+
+    template <std::floating_point T>
+    static T evaluate(T left_operand, T right_operand) noexcept { return left_operand * right_operand; }
+
+    static constexpr bool evaluate_integer(std::int64_t left_operand, std::int64_t right_operand, std::int64_t limit, std::int64_t& result) noexcept
+    {
+        // 結果が範囲外となる場合はオーバーフローを避けるため演算しない
+        if (0 != right_operand && limit / std::abs(right_operand) < std::abs(left_operand))
+            return false;
+
+        // ゼロと負の数の積は、浮動小数点数では負のゼロとなる
+        if ((0 == left_operand && right_operand < 0) || (left_operand < 0 && 0 == right_operand))
+            return false;
+
+        result = left_operand * right_operand;
+        return true;
+    }
+};
+
+// 除算
+template <>
+struct OperatorTraits<'/'> {
+    static constexpr char symbol = '/';
+    static constexpr int precedence = 3;
+    static constexpr Associativity associativity = Associativity::left;
+
+    template <std::floating_point T>
+    static T evaluate(T left_operand, T right_operand) noexcept { return left_operand / right_operand; }
+
+    static constexpr bool evaluate_integer(std::int64_t left_operand, std::int64_t right_operand, std::int64_t, std::int64_t& result) noexcept
+    {
+        // ゼロ除算の結果(無限大・非数)と、割り切れない場合の結果は整数で表せない
+        if (0 == right_operand || 0 != left_operand % right_operand)
+            return false;
+
+        // ゼロを負の数で除算した結果は、浮動小数点数では負のゼロとなる
+        if (0 == left_operand && right_operand < 0)
+            return false;
+
+        result = left_operand / right_operand;
+        return true;
+    }
+};
+
+// 剰余(結果の符号は左項と同じとなる、std::fmodと同じ)
+template <>
+struct OperatorTraits<'%'> {
+    static constexpr char symbol = '%';
+    static constexpr int precedence = 3;
+    static constexpr Associativity associativity = Associativity::left;
+
+    template <std::floating_point T>
+    static T evaluate(T left_operand, T right_operand) noexcept { return std::fmod(left_operand, right_operand); }
+
+    static constexpr bool evaluate_integer(std::int64_t left_operand, std::int64_t right_operand, std::int64_t, std::int64_t& result) noexcept
+    {
+        // ゼロでの剰余の結果(非数)は整数で表せない
+        if (0 == right_operand)
+            return false;
+
+        result = left_operand % right_operand;
+
+        // 負の数を割り切った場合の結果は、浮動小数点数では負のゼロとなる
+        return !(0 == result && left_operand < 0);
+    }
+};
+
+// 累乗
+// (std::powは実装によって誤差を含みうるため、整数で演算した結果とは一致しない場合がある、そのため整数では演算しない)
+template <>
+struct OperatorTraits<'^'> {
+    static constexpr char symbol = '^';
+    static constexpr int precedence = 4;
+    static constexpr Associativity associativity = Associativity::right;
+
+    template <std::floating_point T>
+    static T evaluate(T left_operand, T right_operand) noexcept { return std::pow(left_operand, right_operand); }
+};
+
+// 数値型Tの値を演算できる演算子かどうか
+template <typename Traits, typename T>
+concept EvaluableOperator = std::floating_point<T> && requires(T operand) {
+    { Traits::evaluate(operand, operand) } -> std::same_as<T>;
+};
+
+// 整数のまま演算できる演算子かどうか
+template <typename Traits>
+concept IntegerEvaluableOperator = requires(std::int64_t operand, std::int64_t& result) {
+    { Traits::evaluate_integer(operand, operand, operand, result) } -> std::same_as<bool>;
+};
+
+// 演算子の一覧Symbolsから、分割・計算に用いる表と処理を生成するクラス
+template <char... Symbols>
+class OperatorSet {
+public:
+    // 文字の分類
+    // 演算子の場合は、優先順位と結合性から求めた分割順位(split rank)を分類とする
+    // 分割順位は優先順位が低いほど小さく、同じ優先順位の場合は右結合の演算子の方が1大きい値とする
+    using Class = std::uint8_t;
+
+    static constexpr Class other = 0;               // 演算子・丸括弧以外の文字
+    static constexpr Class open_bracket = 0xFE;     // 開き丸括弧
+    static constexpr Class close_bracket = 0xFF;    // 閉じ丸括弧
+
+    // 分割順位の初期値(どの演算子の分割順位よりも大きい値)
+    static constexpr Class no_operator = 0xFD;
+
+    // 文字chの分類を返す
+    static constexpr Class classify(char ch) noexcept { return classification[static_cast<unsigned char>(ch)]; }
+
+    // 文字chが演算子かどうかを返す
+    static constexpr bool is_operator(char ch) noexcept
+    {
+        auto c = classify(ch);
+
+        return other != c && c < no_operator;
+    }
+
+    // 文字chが式の形を決める文字(演算子と丸括弧)かどうかを返す
+    static constexpr bool is_structural(char ch) noexcept { return other != classify(ch); }
+
+    // 演算子symbolの優先順位を返す(演算子でない場合は0を返す)
+    static constexpr int precedence_of(char symbol) noexcept
+    {
+        auto precedence = 0;
+
+        visit(symbol, [&]<typename Traits>() {
+            precedence = Traits::precedence;
+            return true;
+        });
+
+        return precedence;
+    }
+
+    // 演算子symbolの結合性を返す(演算子でない場合は左結合とする)
+    static constexpr Associativity associativity_of(char symbol) noexcept
+    {
+        auto associativity = Associativity::left;
+
+        visit(symbol, [&]<typename Traits>() {
+            associativity = Traits::associativity;
+            return true;
+        });
+
+        return associativity;
+    }
+
+    // 分割位置の決定規則
+    // 式を先頭から走査し、丸括弧でくくられていない演算子のうち、分割順位がthreshold以下のものを分割位置とする
+    // 分割位置とした場合は、thresholdをその演算子と同じ優先順位の左結合の分割順位に更新する(update_split_threshold)
+    // これにより、最も優先順位が低い演算子のうち、左結合の場合は最も右にあるもの、右結合の場合は最も左にあるものが分割位置となる
+    static constexpr bool splits_at(Class rank, Class threshold) noexcept { return rank <= threshold; }
+    static constexpr Class update_split_threshold(Class rank) noexcept { return static_cast<Class>(rank & ~1); }
+
+    // 演算子symbolの特性をfunctionに与えて呼び出し、その結果を返す(演算子でない場合はfalseを返す)
+    // functionは特性の型を唯一のテンプレート引数とするラムダ式などとし、演算子ごとにインスタンス化される
+    // (記号の比較はコンパイル時に展開されるため、switch文で分岐する場合と同等になる)
+    template <typename Function>
+    static constexpr bool visit(char symbol, Function&& function)
+    {
+        auto result = false;
+
+        static_cast<void>(((Symbols == symbol && (result = function.template operator()<OperatorTraits<Symbols>>(), true)) || ...));
+
+        return result;
+    }
+
+    // 演算子symbolが数値型Tの値を演算できる演算子かどうかを返す
+    template <typename T>
+    static constexpr bool is_evaluable(char symbol) noexcept
+    {
+        return visit(symbol, []<typename Traits>() { return EvaluableOperator<Traits, T>; });
+    }
+
+    // 演算子symbolで、数値型Tの左右の項を演算する(演算できない演算子の場合はfalseを返す)
+    template <std::floating_point T>
+    static bool evaluate(char symbol, T left_operand, T right_operand, T& result) noexcept
+    {
+        return visit(symbol, [&]<typename Traits>() {
+            if constexpr (EvaluableOperator<Traits, T>) {
+                result = Traits::evaluate(left_operand, right_operand);
+                return true;
+            }
+            else {
+                return false;
+            }
+        });
+    }
+
+    // 演算子symbolで、limitの範囲内の整数の左右の項を整数のまま演算する(整数で演算できない場合はfalseを返す)
+    static constexpr bool evaluate_integer(char symbol, std::int64_t left_operand, std::int64_t right_operand, std::int64_t limit, std::int64_t& result) noexcept
+    {
+        return visit(symbol, [&]<typename Traits>() {
+            if constexpr (IntegerEvaluableOperator<Traits>)
+                return Traits::evaluate_integer(left_operand, right_operand, limit, result);
+            else
+                return false;
+        });
+    }
+
+private:
+    static constexpr Class split_rank_of(int precedence, Associativity associativity) noexcept
+    {
+        return static_cast<Class>(precedence * 2 + (Associativity::right == associativity ? 1 : 0));
+    }
+
+    static constexpr std::array<Class, 256> make_classification() noexcept
+    {
+        static_assert(((OperatorTraits<Symbols>::symbol == Symbols) && ...), "symbol of OperatorTraits must match");
+        static_assert(((1 <= OperatorTraits<Symbols>::precedence && split_rank_of(OperatorTraits<Symbols>::precedence, Associativity::right) < no_operator) && ...), "precedence out of range");
+        static_assert(((Symbols != '(' && Symbols != ')' && Symbols != ' ') && ...), "brackets and spaces cannot be operators");
+        static_assert(has_consistent_associativity(), "operators of the same precedence must have the same associativity");
+
+        std::array<Class, 256> table {};
+
+        ((table[static_cast<unsigned char>(Symbols)] = split_rank_of(OperatorTraits<Symbols>::precedence, OperatorTraits<Symbols>::associativity)), ...);
+
+        table[static_cast<unsigned char>('(')] = open_bracket;
+        table[static_cast<unsigned char>(')')] = close_bracket;
+
+        return table;
+    }
+
+    // 同じ優先順位の演算子は、結合性も同じでなければならない
+    static constexpr bool has_consistent_associativity() noexcept
+    {
+        auto consistent = true;
+
+        auto check = [&]<char Symbol>() {
+            ((consistent = consistent && (
+                OperatorTraits<Symbol>::precedence != OperatorTraits<Symbols>::precedence ||
+                OperatorTraits<Symbol>::associativity == OperatorTraits<Symbols>::associativity
+            )), ...);
+        };
+
+        (check.template operator()<Symbols>(), ...);
+
+        return consistent;
+    }
+
+    static constexpr std::array<Class, 256> classification = make_classification();
+};
+
+// 式で使用できる演算子
+using Operators = OperatorSet<'=', '+', '-', '*', '/', '%', '^'>;
+
+} // namespace polish
@@ -0,0 +1,713 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+#include "polish_server.hpp"
+
+#include <iostream>
+
+#if defined(_WIN32)
+
+int run_server(const ServerOptions&)
+{
+    // epollおよびUnixドメインソケットを使用できない環境では、サーバーモードをサポートしない
+    std::cerr << "server mode is not supported on this platform" << std::endl;
+    return 1;
+}
+
+#else
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <format>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "polish.hpp"
+#include "polish_trace.hpp"
+
+namespace {
+
+// 応答時間を記録し、そのパーセンタイルを求めるクラス
+// (直近のcapacity件の応答時間のみを保持する)
+class LatencyRecorder {
+public:
+    static constexpr std::size_t capacity = 65536;
+
+    // 応答時間を記録するメソッド
+    void record(std::chrono::steady_clock::duration latency)
+    {
+        auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+
+        if (samples.size() < capacity)
+            samples.push_back(microseconds);
+        else
+            samples[count % capacity] = microseconds;
+
+        count++;
+    }
+
+    // 記録された応答時間のうち、割合ratioの位置にあるもの(マイクロ秒)を返すメソッド
+    long long percentile(double ratio) const
+    {
+        if (samples.empty())
+            return 0;
+
+        auto sorted = samples;
+        auto nth = sorted.begin() + static_cast<std::ptrdiff_t>(ratio * (sorted.size() - 1));
+
+        std::nth_element(sorted.begin(), nth, sorted.end());
+
+        return *nth;
+    }
+
+    // 処理した要求数と応答時間のパーセンタイルを文字列として返すメソッド
+    std::string report() const
+    {
+        return std::format(
+            "requests: {}\nlatency p50: {} us\nlatency p99: {} us\n",
+            count,
+            percentile(0.50),
+            percentile(0.99)
+        );
+    }
+
+private:
+    std::vector<long long> samples;  // 応答時間(マイクロ秒)
+    std::uint64_t count = 0;         // これまでに記録した応答時間の数
+};
+
+// 要求を処理するワーカースレッドのプール
+class WorkerPool {
+public:
+    WorkerPool(unsigned int worker_count)
+    {
+        for (unsigned int i = 0; i < worker_count; i++) {
+            threads.emplace_back([this, i]() {
+                polish::Tracer::set_thread_name(std::format("worker {}", i));
+                run_worker();
+            });
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        condition.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // 処理taskをいずれかのワーカースレッドで実行するよう登録するメソッド
+    void post(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+
+        condition.notify_one();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+
+    void run_worker()
+    {
+        for (;;) {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+                // 停止する場合でも、登録済みの処理はすべて実行してから終了する
+                if (tasks.empty())
+                    return;
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+};
+
+// クライアントとの接続
+struct Connection {
+    int input_fd;                   // 要求を読み込むファイル記述子
+    int output_fd;                  // 応答を書き込むファイル記述子(ソケットの場合はinput_fdと同じ)
+    std::string read_buffer;        // 読み込んだが、まだ処理していない要求
+    std::string write_buffer;       // まだ書き込んでいない応答
+    std::uint64_t next_request_sequence = 0;    // 次に読み込む要求の通し番号
+    std::uint64_t next_response_sequence = 0;   // 次に書き込む応答の通し番号
+    std::map<std::uint64_t, std::string> completed_responses; // 処理が完了したが、先行する応答を待っている応答
+    bool input_closed = false;      // 要求の読み込みが終了したかどうか
+};
+
+// ワーカースレッドで処理が完了した要求
+struct Completion {
+    std::uint64_t connection_id;    // 要求を受け付けた接続
+    std::uint64_t sequence;         // 要求の通し番号
+    std::string response;           // 応答の本体
+    std::chrono::steady_clock::time_point received_at; // 要求を受け付けた時刻
+};
+
+// epollのイベントループで要求を受け付け、ワーカースレッドのプールで処理するサーバー
+class ExpressionServer {
+public:
+    ExpressionServer(const ServerOptions& options)
+        : options(options),
+          shape_cache(create_shape_cache(options)),
+          workers(std::make_unique<WorkerPool>(0 < options.worker_count ? options.worker_count : std::max(1u, std::thread::hardware_concurrency())))
+    {
+    }
+
+    ~ExpressionServer()
+    {
+        // 実行中の処理が完了するのを待機してから、各ファイル記述子を閉じる
+        workers.reset();
+
+        for (auto& [id, connection] : connections) {
+            if (stdio_connection_id != id)
+                ::close(connection.input_fd);
+        }
+
+        if (0 <= listen_fd) {
+            ::close(listen_fd);
+            ::unlink(options.socket_path.c_str());
+        }
+
+        for (auto fd : { completion_fd, signal_fd, epoll_fd }) {
+            if (0 <= fd)
+                ::close(fd);
+        }
+    }
+
+    // 待ち受けを開始し、停止するまでイベントループを実行するメソッド
+    int run()
+    {
+        epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        completion_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if (epoll_fd < 0 || completion_fd < 0) {
+            report_error("cannot create event loop");
+            return 1;
+        }
+
+        // SIGINT/SIGTERMはsignalfdで受け取る
+        // (ワーカースレッドはこのスレッドのシグナルマスクを引き継いでいるため、シグナルはイベントループでのみ受け取る)
+        sigset_t signals;
+
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+
+        signal_fd = ::signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+        if (signal_fd < 0) {
+            report_error("cannot create signalfd");
+            return 1;
+        }
+
+        if (!add_to_event_loop(completion_fd, EPOLLIN, completion_event_id) ||
+            !add_to_event_loop(signal_fd, EPOLLIN, signal_event_id)) {
+            report_error("cannot register to event loop");
+            return 1;
+        }
+
+        if (options.socket_path.empty()) {
+            if (!accept_stdio())
+                return 1;
+        }
+        else {
+            if (!listen_socket())
+                return 1;
+        }
+
+        run_event_loop();
+
+        // 停止時に、それまでに処理した要求数と応答時間を報告する
+        std::cerr << report() << std::flush;
+
+        return 0;
+    }
+
+private:
+    // epollに登録するイベントの識別子(接続の識別子はfirst_connection_id以降とする)
+    static constexpr std::uint64_t listen_event_id = 0;
+    static constexpr std::uint64_t completion_event_id = 1;
+    static constexpr std::uint64_t signal_event_id = 2;
+    static constexpr std::uint64_t stdout_event_id = 3;
+    static constexpr std::uint64_t first_connection_id = 16;
+    static constexpr std::uint64_t no_connection_id = 0;
+
+    const ServerOptions& options;
+    int epoll_fd = -1;
+    int listen_fd = -1;
+    int completion_fd = -1; // ワーカースレッドでの処理の完了を通知するeventfd
+    int signal_fd = -1;
+    bool stopping = false;
+
+    std::map<std::uint64_t, Connection> connections;
+    std::uint64_t next_connection_id = first_connection_id;
+    std::uint64_t stdio_connection_id = no_connection_id; // 標準入出力での接続の識別子
+
+    std::mutex completions_mutex;
+    std::vector<Completion> completions; // ワーカースレッドで処理が完了した要求
+
+    LatencyRecorder latencies;
+    std::unique_ptr<polish::ShapeCache> shape_cache; // 形状キャッシュ(用いない場合はnullptr)
+    std::unique_ptr<WorkerPool> workers;
+
+    static void report_error(std::string_view message)
+    {
+        std::cerr << message << ": " << std::strerror(errno) << std::endl;
+    }
+
+    static bool set_nonblocking(int fd)
+    {
+        auto flags = ::fcntl(fd, F_GETFL);
+
+        return 0 <= flags && 0 <= ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    bool add_to_event_loop(int fd, std::uint32_t events, std::uint64_t id)
+    {
+        epoll_event event {};
+
+        event.events = events;
+        event.data.u64 = id;
+
+        return 0 == ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    void modify_event_loop(int fd, std::uint32_t events, std::uint64_t id)
+    {
+        epoll_event event {};
+
+        event.events = events;
+        event.data.u64 = id;
+
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+    }
+
+    // 標準入出力を1つの接続として受け付けるメソッド
+    bool accept_stdio()
+    {
+        if (!set_nonblocking(STDIN_FILENO) || !set_nonblocking(STDOUT_FILENO)) {
+            report_error("cannot set stdin/stdout non-blocking");
+            return false;
+        }
+
+        // 標準入力と標準出力を別々にepollに登録する(いずれもパイプまたはソケットである必要がある)
+        auto id = next_connection_id++;
+
+        if (!add_to_event_loop(STDIN_FILENO, EPOLLIN, id) || !add_to_event_loop(STDOUT_FILENO, 0, stdout_event_id)) {
+            report_error("cannot register stdin/stdout to event loop (must be pipes or sockets)");
+            return false;
+        }
+
+        connections.emplace(id, Connection { STDIN_FILENO, STDOUT_FILENO, std::string(), std::string(), 0, 0, {}, false });
+        stdio_connection_id = id;
+
+        return true;
+    }
+
+    // Unixドメインソケットでの待ち受けを開始するメソッド
+    bool listen_socket()
+    {
+        sockaddr_un address {};
+
+        if (sizeof(address.sun_path) <= options.socket_path.length()) {
+            std::cerr << "socket path too long: " << options.socket_path << std::endl;
+            return false;
+        }
+
+        address.sun_family = AF_UNIX;
+        std::copy(options.socket_path.begin(), options.socket_path.end(), address.sun_path);
+
+        // 以前に起動したサーバーのソケットが残っている場合は削除する(ソケット以外のファイルは削除しない)
+        struct stat st;
+
+        if (0 == ::stat(options.socket_path.c_str(), &st) && S_ISSOCK(st.st_mode))
+            ::unlink(options.socket_path.c_str());
+
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        if (listen_fd < 0) {
+            report_error("cannot create socket");
+            return false;
+        }
+
+        if (0 != ::bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address))) {
+            report_error(std::format("cannot bind socket {}", options.socket_path));
+            ::close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+
+        if (0 != ::listen(listen_fd, SOMAXCONN) || !add_to_event_loop(listen_fd, EPOLLIN, listen_event_id)) {
+            report_error("cannot listen socket");
+            return false;
+        }
+
+        return true;
+    }
+
+    void run_event_loop()
+    {
+        epoll_event events[64];
+
+        while (!stopping) {
+            auto count = ::epoll_wait(epoll_fd, events, std::size(events), -1);
+
+            if (count < 0) {
+                if (EINTR == errno)
+                    continue;
+
+                report_error("epoll_wait failed");
+                break;
+            }
+
+            for (auto i = 0; i < count; i++) {
+                switch (auto id = events[i].data.u64) {
+                    case listen_event_id: accept_clients(); break;
+                    case completion_event_id: deliver_completions(); break;
+                    case signal_event_id: stopping = true; break;
+                    case stdout_event_id: handle_stdout_event(events[i].events); break;
+                    default: handle_connection_event(id, events[i].events); break;
+                }
+            }
+        }
+    }
+
+    void accept_clients()
+    {
+        for (;;) {
+            auto fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+            if (fd < 0)
+                // EAGAINの場合は、受け付け待ちの接続がなくなった
+                return;
+
+            auto id = next_connection_id++;
+
+            if (!add_to_event_loop(fd, EPOLLIN, id)) {
+                ::close(fd);
+                continue;
+            }
+
+            connections.emplace(id, Connection { fd, fd, std::string(), std::string(), 0, 0, {}, false });
+        }
+    }
+
+    void handle_connection_event(std::uint64_t id, std::uint32_t events)
+    {
+        auto it = connections.find(id);
+
+        if (connections.end() == it)
+            return;
+
+        auto& connection = it->second;
+
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            read_requests(id, connection);
+
+        if (events & EPOLLOUT)
+            write_responses(connection);
+
+        update_connection(id, connection);
+    }
+
+    void handle_stdout_event(std::uint32_t events)
+    {
+        auto it = connections.find(stdio_connection_id);
+
+        if (connections.end() == it)
+            return;
+
+        auto& connection = it->second;
+
+        if (events & (EPOLLHUP | EPOLLERR))
+            // 標準出力が閉じられた場合は、以降の応答を破棄して接続を終了する
+            discard_responses(connection);
+        else if (events & EPOLLOUT)
+            write_responses(connection);
+
+        update_connection(it->first, connection);
+    }
+
+    // 接続から読み込めるだけ読み込み、読み込んだ要求をワーカースレッドに渡すメソッド
+    void read_requests(std::uint64_t id, Connection& connection)
+    {
+        char buffer[65536];
+
+        while (!connection.input_closed) {
+            auto length = ::read(connection.input_fd, buffer, sizeof(buffer));
+
+            if (0 < length)
+                connection.read_buffer.append(buffer, length);
+            else if (length < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+                break;
+            else if (length < 0 && EINTR == errno)
+                continue;
+            else
+                connection.input_closed = true;
+        }
+
+        auto received_at = std::chrono::steady_clock::now();
+        std::size_t position = 0;
+
+        while (frame_header_length <= connection.read_buffer.length() - position) {
+            auto body_length = decode_frame_length(connection.read_buffer.data() + position);
+
+            if (max_frame_body_length < body_length) {
+                // 長すぎる要求を受け取った場合は、以降の要求を読み込まずに接続を終了する
+                connection.input_closed = true;
+                connection.read_buffer.clear();
+                return;
+            }
+
+            if (connection.read_buffer.length() - position < frame_header_length + body_length)
+                break;
+
+            auto sequence = connection.next_request_sequence++;
+            auto body = connection.read_buffer.substr(position + frame_header_length, body_length);
+
+            position += frame_header_length + body_length;
+
+            if (body.empty()) {
+                // 本体が空の要求に対しては、このスレッドで統計を応答する
+                complete(connection, sequence, report());
+                continue;
+            }
+
+            workers->post([this, id, sequence, received_at, expression = std::move(body)]() {
+                auto response = process_request(expression);
+
+                {
+                    std::lock_guard<std::mutex> lock(completions_mutex);
+                    completions.push_back(Completion { id, sequence, std::move(response), received_at });
+                }
+
+                // イベントループに処理の完了を通知する
+                std::uint64_t value = 1;
+                [[maybe_unused]] auto written = ::write(completion_fd, &value, sizeof(value));
+            });
+        }
+
+        connection.read_buffer.erase(0, position);
+    }
+
+    // 設定に応じて形状キャッシュを作成するメソッド(用いない場合はnullptrを返す)
+    // (機械語への変換を行う場合は、形状キャッシュの大きさが指定されていなくても既定の大きさで作成する)
+    static std::unique_ptr<polish::ShapeCache> create_shape_cache(const ServerOptions& options)
+    {
+        auto capacity = options.shape_cache_capacity;
+
+        if (0 == capacity && 0 < options.compile_threshold)
+            capacity = polish::ShapeCache::default_capacity;
+
+        if (0 == capacity)
+            return nullptr;
+
+        return std::make_unique<polish::ShapeCache>(capacity, options.compile_threshold);
+    }
+
+    // 処理した要求数と応答時間、形状キャッシュの使用状況を文字列として返すメソッド
+    std::string report() const
+    {
+        auto text = latencies.report();
+
+        if (shape_cache)
+            text += std::format("shape cache hits: {}\nshape cache misses: {}\n", shape_cache->hits(), shape_cache->misses());
+
+        if (shape_cache && 0 < options.compile_threshold)
+            text += std::format("compiled shapes: {}\ncompiled evaluations: {}\n", shape_cache->compilations(), shape_cache->compiled_evaluations());
+
+        return text;
+    }
+
+    // 式expressionを分割・計算し、応答の本体を返すメソッド(ワーカースレッドで呼び出される)
+    std::string process_request(const std::string& expression)
+    {
+        std::ostringstream output, error;
+
+        auto status = polish::process_expression(expression, output, error, nullptr, shape_cache.get());
+        auto response = std::format("status: {}\n", status);
+
+        response += output.str();
+
+        if (0 < error.tellp())
+            response += "error: " + error.str();
+
+        return response;
+    }
+
+    // ワーカースレッドで処理が完了した要求の応答を、それぞれの接続に渡すメソッド
+    void deliver_completions()
+    {
+        std::uint64_t value;
+        [[maybe_unused]] auto length = ::read(completion_fd, &value, sizeof(value));
+
+        std::vector<Completion> delivering;
+
+        {
+            std::lock_guard<std::mutex> lock(completions_mutex);
+            delivering.swap(completions);
+        }
+
+        auto now = std::chrono::steady_clock::now();
+
+        for (auto& completion : delivering) {
+            latencies.record(now - completion.received_at);
+
+            // 応答を返す前に切断された接続の要求は、応答を破棄する
+            auto it = connections.find(completion.connection_id);
+
+            if (connections.end() == it)
+                continue;
+
+            complete(it->second, completion.sequence, std::move(completion.response));
+            write_responses(it->second);
+            update_connection(it->first, it->second);
+        }
+    }
+
+    // 要求の応答を、要求を受け付けた順に書き込まれるよう接続に追加するメソッド
+    void complete(Connection& connection, std::uint64_t sequence, std::string response)
+    {
+        connection.completed_responses.emplace(sequence, std::move(response));
+
+        for (;;) {
+            auto it = connection.completed_responses.find(connection.next_response_sequence);
+
+            if (connection.completed_responses.end() == it)
+                break;
+
+            connection.write_buffer += encode_frame(it->second);
+            connection.completed_responses.erase(it);
+            connection.next_response_sequence++;
+        }
+    }
+
+    // 接続に書き込めるだけ応答を書き込むメソッド
+    void write_responses(Connection& connection)
+    {
+        std::size_t position = 0;
+
+        while (position < connection.write_buffer.length()) {
+            auto length = connection.input_fd == connection.output_fd
+                ? ::send(connection.output_fd, connection.write_buffer.data() + position, connection.write_buffer.length() - position, MSG_NOSIGNAL)
+                : ::write(connection.output_fd, connection.write_buffer.data() + position, connection.write_buffer.length() - position);
+
+            if (0 <= length) {
+                position += length;
+            }
+            else if (EINTR != errno) {
+                if (EAGAIN != errno && EWOULDBLOCK != errno) {
+                    // 書き込めない場合は、以降の応答を破棄して接続を終了する
+                    discard_responses(connection);
+                    return;
+                }
+
+                break;
+            }
+        }
+
+        connection.write_buffer.erase(0, position);
+    }
+
+    // 以降の要求の読み込みと応答の書き込みを行わないようにするメソッド
+    static void discard_responses(Connection& connection)
+    {
+        connection.input_closed = true;
+        connection.next_response_sequence = connection.next_request_sequence;
+        connection.completed_responses.clear();
+        connection.write_buffer.clear();
+    }
+
+    // 接続の状態に応じて、epollで待機するイベントを更新するか、接続を終了するメソッド
+    void update_connection(std::uint64_t id, Connection& connection)
+    {
+        auto has_outstanding_requests = connection.next_response_sequence != connection.next_request_sequence;
+
+        if (connection.input_closed && !has_outstanding_requests && connection.write_buffer.empty()) {
+            if (stdio_connection_id == id) {
+                // 標準入出力での接続が終了した場合は、サーバーを停止する
+                stopping = true;
+            }
+            else {
+                ::close(connection.input_fd);
+            }
+
+            connections.erase(id);
+            return;
+        }
+
+        std::uint32_t write_event = connection.write_buffer.empty() ? 0u : static_cast<std::uint32_t>(EPOLLOUT);
+
+        if (connection.input_fd == connection.output_fd) {
+            modify_event_loop(connection.input_fd, (connection.input_closed ? 0u : static_cast<std::uint32_t>(EPOLLIN)) | write_event, id);
+        }
+        else {
+            modify_event_loop(connection.output_fd, write_event, stdout_event_id);
+
+            // 終端に達した標準入力は読み込み可能であり続けるため、epollから削除する
+            if (connection.input_closed)
+                ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection.input_fd, nullptr);
+        }
+    }
+};
+
+} // namespace
+
+int run_server(const ServerOptions& options)
+{
+    // SIGINT/SIGTERMはsignalfdで受け取るため、ワーカースレッドを作成する前にブロックしておく
+    sigset_t signals;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    // 切断されたパイプへの書き込みはエラーとして扱う
+    std::signal(SIGPIPE, SIG_IGN);
+
+    ExpressionServer server(options);
+
+    return server.run();
+}
+
+#endif
@@ -0,0 +1,63 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// 式の分割・計算の要求を受け付け続けるサーバーモードのためのヘッダ
+//
+// 要求・応答はいずれも、本体の長さ(ネットワークバイトオーダーの32ビット符号なし整数)に続けて本体を送る形式とする
+//   要求の本体: 式(実行可能ファイルpolishに入力する式と同じもの)
+//   応答の本体: 終了コードを表す行"status: <code>"に続けて、polishが表示するものと同じ各行
+//               (エラーメッセージは"error: <message>"の行として含める)
+// 本体が空の要求に対しては、それまでに処理した要求数と応答時間のパーセンタイルを応答する
+// (形状キャッシュを用いる場合は、同じ形状の式があった回数・なかった回数と、機械語への変換の状況も応答する)
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// 要求・応答の本体の長さを表すヘッダの長さ
+constexpr std::size_t frame_header_length = 4;
+
+// 受け付ける要求の本体の最大長
+constexpr std::uint32_t max_frame_body_length = 16 * 1024 * 1024;
+
+// 本体bodyに長さを表すヘッダを付加した要求・応答を返す関数
+inline std::string encode_frame(std::string_view body)
+{
+    auto length = static_cast<std::uint32_t>(body.length());
+    std::string frame;
+
+    frame.reserve(frame_header_length + body.length());
+    frame.push_back(static_cast<char>(length >> 24));
+    frame.push_back(static_cast<char>(length >> 16));
+    frame.push_back(static_cast<char>(length >> 8));
+    frame.push_back(static_cast<char>(length));
+    frame.append(body);
+
+    return frame;
+}
+
+// 要求・応答のヘッダheaderから、本体の長さを読み取って返す関数
+inline std::uint32_t decode_frame_length(const char* header)
+{
+    auto bytes = reinterpret_cast<const unsigned char*>(header);
+
+    return
+        (static_cast<std::uint32_t>(bytes[0]) << 24) |
+        (static_cast<std::uint32_t>(bytes[1]) << 16) |
+        (static_cast<std::uint32_t>(bytes[2]) << 8) |
+        static_cast<std::uint32_t>(bytes[3]);
+}
+
+// サーバーモードの設定
+struct ServerOptions {
+    std::string socket_path;        // 待ち受けるUnixドメインソケットのパス(空の場合は標準入出力で要求を受け付ける)
+    unsigned int worker_count = 0;  // 要求を処理するワーカースレッドの数(0の場合はハードウェアスレッド数とする)
+    std::size_t shape_cache_capacity = 0; // 形状キャッシュに保持する式の形状の数(0の場合は形状キャッシュを用いない)
+    std::uint64_t compile_threshold = 0;  // 形状を機械語に変換するまでに値を計算する回数(0の場合は変換しない)
+};
+
+// サーバーモードで動作し、SIGINT/SIGTERMを受け取るまで(標準入出力の場合は入力が終了するまで)要求を処理し続ける関数
+// 正常に終了した場合は0、待ち受けの開始に失敗した場合などは1を返す
+int run_server(const ServerOptions& options);
@@ -0,0 +1,202 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// libpolishの処理ごとの所要時間と、各種の計数を記録するためのヘッダ
+//
+// マクロPOLISH_STATSを定義してビルドした場合のみ記録を行う
+// (定義しない場合、記録を行う箇所はすべて空の処理となり、実行時の負荷はない)
+//
+// 記録はスレッドごとに行い、Statistics::snapshot()ですべてのスレッドの記録を集計する
+//
+// さらにマクロPOLISH_ALLOC_STATSを定義してpolish_alloc.cppをリンクした場合は、
+// グローバルなoperator new/deleteを置き換えて、メモリの確保を処理ごと・式ごとに記録する
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+namespace polish {
+
+// 所要時間を計測する処理の区分
+enum class Phase : std::size_t {
+    strip_spaces,       // 式からの空白の除去
+    validate_bracket,   // 括弧の対応の検証(parseの内側で行われるため、parseの所要時間にも含まれる)
+    parse,              // 二分木への分割
+    write_postorder,    // 後行順序訪問での出力
+    write_inorder,      // 中間順序訪問での出力
+    write_preorder,     // 先行順序訪問での出力
+    calculate,          // 二分木全体の値の計算
+};
+
+constexpr std::size_t phase_count = static_cast<std::size_t>(Phase::calculate) + 1;
+
+// 計数する事象の区分
+enum class Counter : std::size_t {
+    nodes_created,          // 作成したノードの数
+    bytes_copied,           // 式の複製(部分式の切り出しを含む)で複製した文字数
+    parse_number_calls,     // 文字列を数値化した回数
+    format_number_calls,    // 数値を文字列化した回数
+    integer_operations,     // 整数のまま演算した回数
+    shape_cache_hits,       // 形状キャッシュに同じ形状の二分木があった回数
+    shape_cache_misses,     // 形状キャッシュに同じ形状の二分木がなかった回数
+    jit_compilations,       // 形状キャッシュのひな形を機械語に変換した回数
+    jit_evaluations,        // 機械語に変換したひな形で式の値を計算した回数
+    subtrees_reused,        // 差分のみを分割し直す際に、編集前の二分木から再利用した部分木の数
+};
+
+constexpr std::size_t counter_count = static_cast<std::size_t>(Counter::subtrees_reused) + 1;
+
+// 集計した記録
+struct StatisticsSnapshot {
+    std::array<std::uint64_t, phase_count> phase_calls {};          // 処理ごとの回数
+    std::array<std::uint64_t, phase_count> phase_nanoseconds {};    // 処理ごとの所要時間の合計(ナノ秒)
+    std::array<std::uint64_t, counter_count> counters {};           // 事象ごとの回数
+
+    // 処理ごとのメモリの確保(最後の要素は、いずれの処理の内側でもない箇所での確保)
+    // 確保中のメモリの量の最大値は、処理の開始時点からの増分とする
+    std::array<std::uint64_t, phase_count + 1> phase_allocations {};        // 確保した回数
+    std::array<std::uint64_t, phase_count + 1> phase_allocated_bytes {};    // 確保した量
+    std::array<std::uint64_t, phase_count + 1> phase_peak_live_bytes {};    // 確保中のメモリの量の最大値
+
+    // 式ごとのメモリの確保
+    std::uint64_t expressions = 0;                      // 処理した式の数
+    std::uint64_t expression_max_allocations = 0;       // 1つの式で確保した回数の最大値
+    std::uint64_t expression_max_allocated_bytes = 0;   // 1つの式で確保した量の最大値
+    std::uint64_t expression_max_peak_live_bytes = 0;   // 1つの式で確保中のメモリの量の最大値
+};
+
+// 記録を行うクラス
+class Statistics {
+public:
+#if defined(POLISH_STATS)
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    // 事象counterの回数にcountを加算するメソッド
+    static void count(Counter counter, std::uint64_t count = 1) noexcept
+    {
+        if constexpr (enabled)
+            add_count(counter, count);
+    }
+
+    // すべてのスレッドの記録を集計して返すメソッド
+    static StatisticsSnapshot snapshot();
+
+    // すべてのスレッドの記録を破棄するメソッド
+    static void reset();
+
+    // 集計した記録を、人が読むための形式でstreamに出力するメソッド
+    static void write_text(std::ostream& stream, const StatisticsSnapshot& snapshot);
+
+    // 集計した記録を、JSON形式でstreamに出力するメソッド
+    static void write_json(std::ostream& stream, const StatisticsSnapshot& snapshot);
+
+    // 処理・事象の区分の名前を返すメソッド
+    static std::string_view name_of(Phase phase) noexcept;
+    static std::string_view name_of(Counter counter) noexcept;
+
+    // メモリの確保・解放を、現在のスレッドで計測中の処理に対して記録するメソッド
+    // (置き換えたoperator new/deleteから呼び出すため、これらのメソッドはメモリを確保しない)
+    static void record_allocation(std::size_t size) noexcept;
+    static void record_deallocation(std::size_t size) noexcept;
+
+private:
+    friend class PhaseTimer;
+    friend class ExpressionScope;
+
+    // 処理・式の開始時点での、現在のスレッドのメモリの確保の状態
+    struct AllocationScope {
+        std::size_t outer_phase;            // 外側で計測中の処理(ない場合はphase_count)
+        std::int64_t live_bytes;            // 確保中のメモリの量
+        std::int64_t outer_max_live_bytes;  // 外側の処理での、確保中のメモリの量の最大値
+        std::uint64_t allocations;          // それまでに確保した回数
+        std::uint64_t allocated_bytes;      // それまでに確保した量
+    };
+
+    static void add_count(Counter counter, std::uint64_t count) noexcept;
+
+    // 現在のスレッドで処理phaseを計測中かどうかを設定・取得するメソッド
+    // (再帰的に呼び出される処理を、最も外側の呼び出しでのみ計測するために用いる)
+    static bool enter_phase(Phase phase, AllocationScope& scope) noexcept;
+    static void leave_phase(Phase phase, std::chrono::steady_clock::duration elapsed, const AllocationScope& scope) noexcept;
+
+    // 現在のスレッドで式の処理を開始・終了するメソッド
+    // (入れ子になった場合は、最も外側のみを1つの式として記録する)
+    static bool enter_expression(AllocationScope& scope) noexcept;
+    static void leave_expression(const AllocationScope& scope) noexcept;
+};
+
+// 生存期間中の経過時間を、処理phaseの所要時間として記録するクラス
+// 同じスレッドで同じ処理を計測中の場合(再帰呼び出しの場合)は、何も記録しない
+#if defined(POLISH_STATS)
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Phase phase) noexcept
+        : phase(phase),
+          outermost(Statistics::enter_phase(phase, scope)),
+          started_at(outermost ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point())
+    {
+    }
+
+    ~PhaseTimer()
+    {
+        if (outermost)
+            Statistics::leave_phase(phase, std::chrono::steady_clock::now() - started_at, scope);
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    Phase phase;
+    Statistics::AllocationScope scope;
+    bool outermost;
+    std::chrono::steady_clock::time_point started_at;
+};
+
+// 生存期間中に行われたメモリの確保を、1つの式に対するものとして記録するクラス
+class ExpressionScope {
+public:
+    ExpressionScope() noexcept
+        : outermost(Statistics::enter_expression(scope))
+    {
+    }
+
+    ~ExpressionScope()
+    {
+        if (outermost)
+            Statistics::leave_expression(scope);
+    }
+
+    ExpressionScope(const ExpressionScope&) = delete;
+    ExpressionScope& operator=(const ExpressionScope&) = delete;
+
+private:
+    Statistics::AllocationScope scope;
+    bool outermost;
+};
+#else
+class PhaseTimer {
+public:
+    explicit constexpr PhaseTimer(Phase) noexcept {}
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+};
+
+class ExpressionScope {
+public:
+    constexpr ExpressionScope() noexcept {}
+
+    ExpressionScope(const ExpressionScope&) = delete;
+    ExpressionScope& operator=(const ExpressionScope&) = delete;
+};
+#endif
+
+} // namespace polish
@@ -0,0 +1,52 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// 他の言語との共通のテストケース(tests/impls/testcases/*.jsonc)を読み込むためのヘッダ
+// (polish-compareやpolish-checkなど、テストケースを入力として用いるツールで使用する)
+#pragma once
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace polish {
+
+// テストケースのファイルの内容contentから、"Input"の値をすべて読み込む関数
+inline std::vector<std::string> read_testcase_inputs(const std::string& content)
+{
+    std::vector<std::string> inputs;
+    std::string_view key = "\"Input\"";
+
+    for (auto pos = content.find(key); std::string::npos != pos; pos = content.find(key, pos)) {
+        pos = content.find('"', content.find(':', pos + key.length()));
+
+        if (std::string::npos == pos)
+            break;
+
+        // JSONの文字列を読み込む(テストケースで使用されるエスケープは\"と\\のみとする)
+        std::string input;
+
+        for (pos++; pos < content.length() && '"' != content[pos]; pos++) {
+            if ('\\' == content[pos] && pos + 1 < content.length())
+                pos++;
+
+            input += content[pos];
+        }
+
+        inputs.push_back(std::move(input));
+    }
+
+    return inputs;
+}
+
+// テストケースのファイルpathを読み込み、"Input"の値をすべて返す関数
+inline std::vector<std::string> read_testcase_file(const std::string& path)
+{
+    std::ifstream stream(path);
+
+    return read_testcase_inputs(std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()));
+}
+
+} // namespace polish
@@ -0,0 +1,88 @@
+// SPDX-FileCopyrightText: 2022 smdn <smdn@smdn.jp>
+// SPDX-License-Identifier: MIT
+//
+// libpolishの処理の開始・終了を記録し、Chromeのtrace event形式(JSON)で出力するためのヘッダ
+// 出力したファイルは、Perfetto(https://ui.perfetto.dev/)やchrome://tracingで表示することができる
+//
+// 使用例:
+//   polish::Tracer::start();
+//   polish::process_expression("1 + 2", std::cout, std::cerr);
+//   polish::Tracer::stop();
+//   polish::Tracer::write_json(file);
+//
+// 記録はスレッドごとのリングバッファに、ロックを取らずに書き込む
+// (バッファが一杯になった場合は古いものから上書きする)
+// 記録していない間の負荷は、記録中かどうかの判定1回のみとなる
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+namespace polish {
+
+// 記録に付加する引数の種類
+enum class TraceArgument {
+    none,       // 引数なし
+    sequence,   // 記録を開始してからの通し番号(式ごとの記録を識別するために用いる)
+};
+
+// 処理の開始・終了を記録するクラス
+class Tracer {
+public:
+    // スレッドごとのリングバッファに記録できる数の既定値
+    static constexpr std::size_t default_buffer_capacity = 0x10000;
+
+    // 記録を開始・停止するメソッド
+    // (バッファの大きさは、その後に初めて記録するスレッドのバッファから適用される)
+    static void start(std::size_t buffer_capacity = default_buffer_capacity);
+    static void stop() noexcept;
+
+    // 記録中かどうかを返すメソッド
+    static bool enabled() noexcept { return active.load(std::memory_order_relaxed); }
+
+    // 現在のスレッドに、表示に用いる名前を設定するメソッド(記録中でない場合は何もしない)
+    static void set_thread_name(std::string_view name);
+
+    // 処理nameの開始・終了を、現在のスレッドのバッファに記録するメソッド
+    // (nameは文字列リテラルなど、記録を出力するまで有効なものを与える必要がある)
+    static void begin(const char* name, TraceArgument argument) noexcept;
+    static void end(const char* name) noexcept;
+
+    // すべてのスレッドの記録を、trace event形式でstreamに出力するメソッド
+    // (記録中のスレッドがない状態で呼び出す必要がある)
+    static void write_json(std::ostream& stream);
+
+private:
+    static inline std::atomic<bool> active = false;
+};
+
+// 生存期間を、処理nameの開始から終了までとして記録するクラス
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, TraceArgument argument = TraceArgument::none) noexcept
+        : name(name)
+    {
+        if (Tracer::enabled()) [[unlikely]] {
+            traced = true;
+            Tracer::begin(name, argument);
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (traced) [[unlikely]]
+            Tracer::end(name);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    bool traced = false;
+};
+
+} // namespace polish